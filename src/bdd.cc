@@ -107,16 +107,14 @@ void bdd::updatebdd() {
   /*
    * Les transaction sont atomiques
    */
-  list<shot>::iterator il;
-
-  for (il = f->shots.begin(); il != f->shots.end(); il++) {
-    sec = (int)(il->msbegin / 1000);
+  f->for_each_shot([&](shot &s) {
+    sec = (int)(s.msbegin / 1000);
     min = sec / 60;
     hr = min / 60;
     min %= 60;
     sec %= 60;
 
-    secd = (int)(il->msduration / 1000);
+    secd = (int)(s.msduration / 1000);
     mind = secd / 60;
     hrd = mind / 60;
     mind %= 60;
@@ -131,7 +129,7 @@ void bdd::updatebdd() {
     result = PQexec(conn, query);
     free(result);
     i++;
-  }
+  });
 }
 
 bdd::~bdd() {}
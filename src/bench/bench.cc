@@ -0,0 +1,179 @@
+/*
+ * shotdetect-bench: run film::process() on a clip with known ground truth
+ * (see shotdetect-synth) and report throughput, peak memory and detection
+ * quality.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ */
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <film.h>
+#include <format.h>
+#include <bench/cutlist.h>
+
+static double seconds(const timeval &tv) {
+  return double(tv.tv_sec) + 1.0e-6 * double(tv.tv_usec);
+}
+
+static bool near_any(int frame, const vector<int> &frames, int tolerance) {
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (abs(frame - frames[i]) <= tolerance) return true;
+  }
+  return false;
+}
+
+static bool inside_fade(int frame, const vector<cutlist::range> &fades,
+                        int tolerance) {
+  for (size_t i = 0; i < fades.size(); i++) {
+    if (frame >= fades[i].first - tolerance &&
+        frame <= fades[i].last + tolerance)
+      return true;
+  }
+  return false;
+}
+
+static void show_help(char **argv) {
+  printf(
+      "\nUsage: %s -i file [options]\n"
+      "-i file      : input video\n"
+      "-t file      : ground truth (Default=<input>.cuts)\n"
+      "-o path      : scratch output path (Default=/tmp)\n"
+      "-s threshold : threshold (Default=%d)\n"
+      "-T frames    : matching tolerance in frames (Default=1)\n"
+      "-G           : do not draw RGB/HSV graphs\n"
+      "-S           : lean mode with the sampled SAD estimate\n",
+      argv[0], DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char **argv) {
+  film f = film();
+  string input_path;
+  string truth_path;
+  string output_path = "/tmp";
+  int tolerance = 1;
+
+  f.threshold = DEFAULT_THRESHOLD;
+  f.set_draw_rgb_graph(true);
+  f.set_draw_hsv_graph(true);
+  f.set_draw_yuv_graph(false);
+
+  for (;;) {
+    int c = getopt(argc, argv, "?hi:t:o:s:T:GS");
+    if (c < 0) {
+      break;
+    }
+    switch (c) {
+      case 'i': input_path = optarg; break;
+      case 't': truth_path = optarg; break;
+      case 'o': output_path = optarg; break;
+      case 's': f.set_threshold(atoi(optarg)); break;
+      case 'T': tolerance = atoi(optarg); break;
+      case 'G':
+        f.set_draw_rgb_graph(false);
+        f.set_draw_hsv_graph(false);
+        break;
+      case 'S':
+        f.set_lean(true);
+        f.set_sampled_sad(true);
+        break;
+      default:
+        show_help(argv);
+        exit(EXIT_SUCCESS);
+    }
+  }
+  if (input_path.empty()) {
+    show_help(argv);
+    exit(EXIT_FAILURE);
+  }
+  if (truth_path.empty()) {
+    truth_path = input_path + ".cuts";
+  }
+
+  cutlist truth;
+  if (!truth.read(truth_path)) {
+    cerr << "ERROR: cannot read ground truth " << truth_path << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  f.set_ipath(input_path);
+  f.set_opath(output_path);
+  f.set_alphaid("bench");
+
+  timeval wall_start, wall_end;
+  gettimeofday(&wall_start, NULL);
+  if (f.process() != 0) {
+    cerr << "ERROR: processing " << input_path << " failed" << endl;
+    exit(EXIT_FAILURE);
+  }
+  gettimeofday(&wall_end, NULL);
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const double wall_s = seconds(wall_end) - seconds(wall_start);
+  const double cpu_s = seconds(usage.ru_utime) + seconds(usage.ru_stime);
+
+  /*
+   * Score the detected cuts against the known ones. The first shot always
+   * starts at frame 0 and is not a detection.
+   */
+  vector<int> detected;
+  for (list<shot>::iterator il = f.shots.begin(); il != f.shots.end(); il++) {
+    if (il->myid != 0) detected.push_back(il->fbegin);
+  }
+
+  vector<bool> used(detected.size(), false);
+  int true_pos = 0;
+  for (size_t i = 0; i < truth.cuts.size(); i++) {
+    int best = -1;
+    for (size_t j = 0; j < detected.size(); j++) {
+      int distance = abs(detected[j] - truth.cuts[i]);
+      if (!used[j] && distance <= tolerance &&
+          (best < 0 || distance < abs(detected[best] - truth.cuts[i]))) {
+        best = int(j);
+      }
+    }
+    if (best >= 0) {
+      used[best] = true;
+      true_pos++;
+    }
+  }
+
+  int false_pos = 0, fp_fades = 0, fp_flashes = 0;
+  for (size_t j = 0; j < detected.size(); j++) {
+    if (used[j]) continue;
+    false_pos++;
+    if (inside_fade(detected[j], truth.fades, tolerance)) fp_fades++;
+    if (near_any(detected[j], truth.flashes, tolerance + 1)) fp_flashes++;
+  }
+  const int false_neg = int(truth.cuts.size()) - true_pos;
+
+  const double precision =
+      detected.empty() ? 1.0 : double(true_pos) / detected.size();
+  const double recall =
+      truth.cuts.empty() ? 1.0 : double(true_pos) / truth.cuts.size();
+  const double media_s = double(truth.frames) / truth.fps;
+
+  fmt::print("input:           {} ({}x{}, {} fps, {} frames)\n", input_path,
+             truth.width, truth.height, truth.fps, truth.frames);
+  fmt::print("threshold:       {}\n", f.threshold);
+  fmt::print("wall time:       {:.3f} s\n", wall_s);
+  fmt::print("cpu time:        {:.3f} s\n", cpu_s);
+  fmt::print("realtime factor: {:.2f}x\n", media_s / wall_s);
+  fmt::print("frames/s:        {:.1f}\n", truth.frames / wall_s);
+  fmt::print("peak RSS:        {} KiB\n", usage.ru_maxrss);
+  fmt::print("cuts:            {} known, {} detected\n", truth.cuts.size(),
+             detected.size());
+  fmt::print("true positives:  {}\n", true_pos);
+  fmt::print("false positives: {} ({} in fades, {} at flashes)\n", false_pos,
+             fp_fades, fp_flashes);
+  fmt::print("false negatives: {}\n", false_neg);
+  fmt::print("precision:       {:.4f}\n", precision);
+  fmt::print("recall:          {:.4f}\n", recall);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Ground truth description of a synthetic clip, as written by
+ * shotdetect-synth and read back by shotdetect-bench.
+ *
+ * The file is plain text, one record per line:
+ *
+ *   frames <n>          total number of encoded frames
+ *   fps <n>             frame rate
+ *   size <w> <h>        frame dimensions
+ *   cut <frame>         first frame of a new shot after a hard cut
+ *   fade <first> <last> frames covered by a cross-fade
+ *   flash <frame>       single white frame inside a shot
+ *
+ * Frame numbers are 1-based, as counted by the decoder
+ * (AVCodecContext::frame_number), so they compare directly with
+ * shot::fbegin.
+ */
+#ifndef __CUTLIST_H__
+#define __CUTLIST_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct cutlist {
+  struct range {
+    int first;
+    int last;
+  };
+
+  int frames;
+  int fps;
+  int width;
+  int height;
+  std::vector<int> cuts;
+  std::vector<range> fades;
+  std::vector<int> flashes;
+
+  cutlist() : frames(0), fps(0), width(0), height(0) {}
+
+  bool write(const std::string &path) const {
+    FILE *fd = fopen(path.c_str(), "w");
+    if (fd == NULL) {
+      return false;
+    }
+    fprintf(fd, "frames %d\nfps %d\nsize %d %d\n", frames, fps, width,
+            height);
+    for (size_t i = 0; i < cuts.size(); i++) {
+      fprintf(fd, "cut %d\n", cuts[i]);
+    }
+    for (size_t i = 0; i < fades.size(); i++) {
+      fprintf(fd, "fade %d %d\n", fades[i].first, fades[i].last);
+    }
+    for (size_t i = 0; i < flashes.size(); i++) {
+      fprintf(fd, "flash %d\n", flashes[i]);
+    }
+    return fclose(fd) == 0;
+  }
+
+  bool read(const std::string &path) {
+    char line[128];
+    char key[16];
+    int a, b;
+    FILE *fd = fopen(path.c_str(), "r");
+    if (fd == NULL) {
+      return false;
+    }
+    while (fgets(line, sizeof(line), fd) != NULL) {
+      int n = sscanf(line, "%15s %d %d", key, &a, &b);
+      if (n < 2) {
+        continue;
+      }
+      if (!strcmp(key, "frames")) {
+        frames = a;
+      } else if (!strcmp(key, "fps")) {
+        fps = a;
+      } else if (!strcmp(key, "size") && n == 3) {
+        width = a;
+        height = b;
+      } else if (!strcmp(key, "cut")) {
+        cuts.push_back(a);
+      } else if (!strcmp(key, "fade") && n == 3) {
+        range r = {a, b};
+        fades.push_back(r);
+      } else if (!strcmp(key, "flash")) {
+        flashes.push_back(a);
+      }
+    }
+    fclose(fd);
+    return frames > 0;
+  }
+};
+
+#endif /* !__CUTLIST_H__ */
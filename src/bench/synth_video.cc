@@ -0,0 +1,386 @@
+/*
+ * shotdetect-synth: encode a deterministic synthetic clip with a known
+ * list of hard cuts, cross-fades and single-frame flashes.
+ *
+ * Every shot is a procedural pattern (moving stripes over a checker
+ * board, with its own base colour and speed), so content does not depend
+ * on any licensed footage and the same seed always yields the same clip.
+ * The ground truth is written next to the video as "<output>.cuts", see
+ * cutlist.h for the format.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ */
+
+#ifndef INT64_C
+#define INT64_C(c) (c##LL)
+#define UINT64_C(c) (c##ULL)
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <bench/cutlist.h>
+
+using namespace std;
+
+/* Small deterministic generator (xorshift32), independent of libc rand() */
+class rng {
+  uint32_t state;
+
+ public:
+  explicit rng(uint32_t seed) : state(seed ? seed : 0x9e3779b9) {}
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  int range(int lo, int hi) { return lo + int(next() % uint32_t(hi - lo + 1)); }
+};
+
+/* Visual parameters of one shot */
+struct shot_look {
+  int y0, u0, v0;
+  int fx, fy;
+  int speed;
+  int block;
+};
+
+/* One shot on the timeline, optionally entered through a cross-fade */
+struct segment {
+  shot_look look;
+  int first;     // 0-based index of the first frame
+  int length;    // frames, fade excluded
+  int fade_in;   // frames of cross-fade from the previous shot
+};
+
+struct settings {
+  string output;
+  string codec;
+  int width;
+  int height;
+  int fps;
+  int duration;
+  int gop;
+  int bitrate;
+  int seed;
+  double min_shot;
+  double max_shot;
+  int fade_percent;
+  int fade_length;
+  int flashes_per_minute;
+};
+
+static inline uint8_t clip(int v) {
+  return v < 0 ? 0 : (v > 255 ? 255 : uint8_t(v));
+}
+
+static shot_look random_look(rng &r, const shot_look *prev) {
+  shot_look l;
+  do {
+    l.y0 = r.range(40, 215);
+    l.u0 = r.range(64, 192);
+    l.v0 = r.range(64, 192);
+  } while (prev != NULL && abs(l.y0 - prev->y0) + abs(l.u0 - prev->u0) +
+                                   abs(l.v0 - prev->v0) <
+                               90);
+  l.fx = r.range(1, 4);
+  l.fy = r.range(0, 3);
+  l.speed = r.range(1, 6);
+  l.block = 8 << r.range(0, 3);
+  return l;
+}
+
+/*
+ * Render frame t of a shot into YUV 4:2:0 planes
+ */
+static void render(const shot_look &l, int t, int width, int height,
+                   uint8_t *py, int ly, uint8_t *pu, int lu, uint8_t *pv,
+                   int lv) {
+  for (int y = 0; y < height; y++) {
+    uint8_t *row = py + y * ly;
+    for (int x = 0; x < width; x++) {
+      int phase = ((x * l.fx + y * l.fy + t * l.speed) >> 1) & 127;
+      int stripe = (phase < 64 ? phase : 127 - phase) - 32;
+      int checker = (((x / l.block) ^ (y / l.block)) & 1) ? 12 : -12;
+      row[x] = clip(l.y0 + stripe + checker);
+    }
+  }
+  for (int y = 0; y < height / 2; y++) {
+    for (int x = 0; x < width / 2; x++) {
+      pu[y * lu + x] = clip(l.u0 + ((x + t) & 15) - 8);
+      pv[y * lv + x] = clip(l.v0 + ((y + t) & 15) - 8);
+    }
+  }
+}
+
+static vector<segment> plan(const settings &s, rng &r, cutlist &truth) {
+  vector<segment> timeline;
+  const int total = s.fps * s.duration;
+  const int min_len = max(2, int(s.min_shot * s.fps));
+  const int max_len = max(min_len, int(s.max_shot * s.fps));
+  int pos = 0;
+
+  while (pos < total) {
+    segment seg;
+    seg.look = random_look(r, timeline.empty() ? NULL : &timeline.back().look);
+    seg.fade_in = 0;
+    if (!timeline.empty() && r.range(0, 99) < s.fade_percent) {
+      seg.fade_in = s.fade_length;
+      cutlist::range fade = {pos + 1, pos + seg.fade_in};
+      truth.fades.push_back(fade);
+    } else if (!timeline.empty()) {
+      truth.cuts.push_back(pos + 1);
+    }
+    seg.first = pos + seg.fade_in;
+    seg.length = min(r.range(min_len, max_len), max(1, total - seg.first));
+    pos = seg.first + seg.length;
+    timeline.push_back(seg);
+
+    /* Place flashes well inside the shot, away from any boundary */
+    const int flash_margin = 5;
+    if (seg.length > 4 * flash_margin &&
+        r.range(0, 59 * s.fps) < s.flashes_per_minute * seg.length) {
+      truth.flashes.push_back(
+          seg.first + r.range(flash_margin, seg.length - flash_margin) + 1);
+    }
+  }
+  truth.frames = pos;
+  return timeline;
+}
+
+static int encode(AVFormatContext *oc, AVStream *st, AVFrame *frame) {
+  AVPacket pkt;
+  int got_packet = 0;
+  av_init_packet(&pkt);
+  pkt.data = NULL;
+  pkt.size = 0;
+
+  if (avcodec_encode_video2(st->codec, &pkt, frame, &got_packet) < 0) {
+    fprintf(stderr, "Error while encoding frame\n");
+    exit(EXIT_FAILURE);
+  }
+  if (got_packet) {
+    av_packet_rescale_ts(&pkt, st->codec->time_base, st->time_base);
+    pkt.stream_index = st->index;
+    av_interleaved_write_frame(oc, &pkt);
+  }
+  return got_packet;
+}
+
+static void show_help(char **argv) {
+  printf(
+      "\nUsage: %s -o file [options]\n"
+      "-o file      : output video (container chosen from the extension)\n"
+      "-c codec     : encoder name (Default=mpeg4)\n"
+      "-W width     : frame width (Default=640)\n"
+      "-H height    : frame height (Default=360)\n"
+      "-r fps       : frame rate (Default=25)\n"
+      "-d seconds   : clip duration (Default=60)\n"
+      "-g gop       : GOP size (Default=12)\n"
+      "-b kbit/s    : bitrate (Default=2000)\n"
+      "-S seed      : random seed (Default=1)\n"
+      "-l seconds   : minimum shot length (Default=1.0)\n"
+      "-L seconds   : maximum shot length (Default=5.0)\n"
+      "-f percent   : share of transitions that are cross-fades (Default=15)\n"
+      "-F frames    : cross-fade length (Default=12)\n"
+      "-x n         : flashes per minute (Default=2)\n",
+      argv[0]);
+}
+
+int main(int argc, char **argv) {
+  settings s;
+  s.codec = "mpeg4";
+  s.width = 640;
+  s.height = 360;
+  s.fps = 25;
+  s.duration = 60;
+  s.gop = 12;
+  s.bitrate = 2000;
+  s.seed = 1;
+  s.min_shot = 1.0;
+  s.max_shot = 5.0;
+  s.fade_percent = 15;
+  s.fade_length = 12;
+  s.flashes_per_minute = 2;
+
+  for (;;) {
+    int c = getopt(argc, argv, "?ho:c:W:H:r:d:g:b:S:l:L:f:F:x:");
+    if (c < 0) {
+      break;
+    }
+    switch (c) {
+      case 'o': s.output = optarg; break;
+      case 'c': s.codec = optarg; break;
+      case 'W': s.width = atoi(optarg) & ~1; break;
+      case 'H': s.height = atoi(optarg) & ~1; break;
+      case 'r': s.fps = atoi(optarg); break;
+      case 'd': s.duration = atoi(optarg); break;
+      case 'g': s.gop = atoi(optarg); break;
+      case 'b': s.bitrate = atoi(optarg); break;
+      case 'S': s.seed = atoi(optarg); break;
+      case 'l': s.min_shot = atof(optarg); break;
+      case 'L': s.max_shot = atof(optarg); break;
+      case 'f': s.fade_percent = atoi(optarg); break;
+      case 'F': s.fade_length = max(1, atoi(optarg)); break;
+      case 'x': s.flashes_per_minute = atoi(optarg); break;
+      default:
+        show_help(argv);
+        exit(EXIT_SUCCESS);
+    }
+  }
+  if (s.output.empty() || s.width <= 0 || s.height <= 0 || s.fps <= 0 ||
+      s.duration <= 0) {
+    show_help(argv);
+    exit(EXIT_FAILURE);
+  }
+
+  rng r(uint32_t(s.seed));
+  cutlist truth;
+  truth.fps = s.fps;
+  truth.width = s.width;
+  truth.height = s.height;
+  vector<segment> timeline = plan(s, r, truth);
+
+  /*
+   * Set up muxer and encoder
+   */
+  av_register_all();
+  AVFormatContext *oc = NULL;
+  avformat_alloc_output_context2(&oc, NULL, NULL, s.output.c_str());
+  if (oc == NULL) {
+    fprintf(stderr, "Could not deduce output format from %s\n",
+            s.output.c_str());
+    exit(EXIT_FAILURE);
+  }
+  AVCodec *codec = avcodec_find_encoder_by_name(s.codec.c_str());
+  if (codec == NULL) {
+    fprintf(stderr, "Encoder %s not found\n", s.codec.c_str());
+    exit(EXIT_FAILURE);
+  }
+  AVStream *st = avformat_new_stream(oc, codec);
+  AVCodecContext *c = st->codec;
+  c->codec_id = codec->id;
+  c->width = s.width;
+  c->height = s.height;
+  c->time_base.num = 1;
+  c->time_base.den = s.fps;
+  st->time_base = c->time_base;
+  c->gop_size = s.gop;
+  c->bit_rate = int64_t(s.bitrate) * 1000;
+  c->pix_fmt = AV_PIX_FMT_YUV420P;
+  if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+    c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  if (avcodec_open2(c, codec, NULL) < 0) {
+    fprintf(stderr, "Could not open encoder %s\n", s.codec.c_str());
+    exit(EXIT_FAILURE);
+  }
+  if (avio_open(&oc->pb, s.output.c_str(), AVIO_FLAG_WRITE) < 0 ||
+      avformat_write_header(oc, NULL) < 0) {
+    fprintf(stderr, "Could not write %s\n", s.output.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  AVFrame *frame = av_frame_alloc();
+  frame->format = c->pix_fmt;
+  frame->width = s.width;
+  frame->height = s.height;
+  av_frame_get_buffer(frame, 32);
+
+  /* Scratch planes for the outgoing shot of a cross-fade */
+  const int luma = s.width * s.height;
+  const int chroma = luma / 4;
+  vector<uint8_t> fade_buf(luma + 2 * chroma);
+
+  size_t next_flash = 0;
+  int pts = 0;
+  for (size_t i = 0; i < timeline.size(); i++) {
+    const segment &seg = timeline[i];
+    const int begin = seg.first - seg.fade_in;
+    for (int n = begin; n < seg.first + seg.length; n++, pts++) {
+      av_frame_make_writable(frame);
+      uint8_t *py = frame->data[0];
+      uint8_t *pu = frame->data[1];
+      uint8_t *pv = frame->data[2];
+
+      render(seg.look, n - seg.first, s.width, s.height, py,
+             frame->linesize[0], pu, frame->linesize[1], pv,
+             frame->linesize[2]);
+
+      if (n < seg.first) {
+        /* Cross-fade: blend with the continuation of the previous shot */
+        const segment &prev = timeline[i - 1];
+        const int alpha = (256 * (n - begin + 1)) / (seg.fade_in + 1);
+        uint8_t *fy = &fade_buf[0];
+        uint8_t *fu = fy + luma;
+        uint8_t *fv = fu + chroma;
+        render(prev.look, n - prev.first, s.width, s.height, fy, s.width, fu,
+               s.width / 2, fv, s.width / 2);
+        for (int y = 0; y < s.height; y++) {
+          for (int x = 0; x < s.width; x++) {
+            uint8_t &d = py[y * frame->linesize[0] + x];
+            d = uint8_t((d * alpha + fy[y * s.width + x] * (256 - alpha)) >> 8);
+          }
+        }
+        for (int y = 0; y < s.height / 2; y++) {
+          for (int x = 0; x < s.width / 2; x++) {
+            uint8_t &du = pu[y * frame->linesize[1] + x];
+            uint8_t &dv = pv[y * frame->linesize[2] + x];
+            du = uint8_t((du * alpha + fu[y * s.width / 2 + x] * (256 - alpha)) >> 8);
+            dv = uint8_t((dv * alpha + fv[y * s.width / 2 + x] * (256 - alpha)) >> 8);
+          }
+        }
+      }
+
+      if (next_flash < truth.flashes.size() &&
+          truth.flashes[next_flash] == n + 1) {
+        for (int y = 0; y < s.height; y++) {
+          memset(py + y * frame->linesize[0], 235, s.width);
+        }
+        for (int y = 0; y < s.height / 2; y++) {
+          memset(pu + y * frame->linesize[1], 128, s.width / 2);
+          memset(pv + y * frame->linesize[2], 128, s.width / 2);
+        }
+        next_flash++;
+      }
+
+      frame->pts = pts;
+      encode(oc, st, frame);
+    }
+  }
+
+  /* Drain delayed frames */
+  while (encode(oc, st, NULL)) {
+  }
+  av_write_trailer(oc);
+
+  av_frame_free(&frame);
+  avcodec_close(c);
+  avio_closep(&oc->pb);
+  avformat_free_context(oc);
+
+  string truth_path = s.output + ".cuts";
+  if (!truth.write(truth_path)) {
+    fprintf(stderr, "Could not write %s\n", truth_path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  printf("%s: %d frames, %zu cuts, %zu fades, %zu flashes\n",
+         s.output.c_str(), truth.frames, truth.cuts.size(),
+         truth.fades.size(), truth.flashes.size());
+  return 0;
+}
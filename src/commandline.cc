@@ -13,6 +13,9 @@
  * Boston, MA 02110-1301 USA $Id: main.cpp 164 2007-10-13 23:53:21Z johmathe $
  */
 #include <stdlib.h>
+#include <getopt.h>
+#include <algorithm>
+#include <sstream>
 
 #include <version.h>
 #include <film.h>
@@ -43,6 +46,53 @@ class film;
 //-m : generates the thumbnails images
 //-r : generates the real size images
 
+/* Options without a short form */
+enum {
+  OPT_MAX_MEMORY = 256,
+  OPT_GRAPH_WIDTH,
+  OPT_GRAPH_TILES,
+  OPT_GRAPH_CHUNKS,
+  OPT_GRAPH_SVG,
+  OPT_LEAN,
+  OPT_MJPEG,
+  OPT_THUMB_SIZES,
+  OPT_SPRITE_SHEET,
+  OPT_PACK,
+  OPT_DEFERRED_IMAGES,
+  OPT_TILE_RATIO,
+  OPT_HISTOGRAM,
+  OPT_GRADUAL,
+  OPT_ADAPTIVE,
+  OPT_FLASH_FILTER,
+  OPT_PREFILTER,
+  OPT_MOTION_VECTORS,
+  OPT_DETECTOR,
+  OPT_SAMPLED_SAD,
+};
+
+static const struct option long_options[] = {
+    {"max-memory", required_argument, NULL, OPT_MAX_MEMORY},
+    {"graph-width", required_argument, NULL, OPT_GRAPH_WIDTH},
+    {"graph-tiles", no_argument, NULL, OPT_GRAPH_TILES},
+    {"graph-chunks", no_argument, NULL, OPT_GRAPH_CHUNKS},
+    {"graph-svg", no_argument, NULL, OPT_GRAPH_SVG},
+    {"lean", no_argument, NULL, OPT_LEAN},
+    {"mjpeg", no_argument, NULL, OPT_MJPEG},
+    {"thumb-sizes", required_argument, NULL, OPT_THUMB_SIZES},
+    {"sprite-sheet", required_argument, NULL, OPT_SPRITE_SHEET},
+    {"pack", no_argument, NULL, OPT_PACK},
+    {"deferred-images", no_argument, NULL, OPT_DEFERRED_IMAGES},
+    {"tile-ratio", required_argument, NULL, OPT_TILE_RATIO},
+    {"histogram", required_argument, NULL, OPT_HISTOGRAM},
+    {"gradual", required_argument, NULL, OPT_GRADUAL},
+    {"adaptive", required_argument, NULL, OPT_ADAPTIVE},
+    {"flash-filter", required_argument, NULL, OPT_FLASH_FILTER},
+    {"prefilter", required_argument, NULL, OPT_PREFILTER},
+    {"motion-vectors", required_argument, NULL, OPT_MOTION_VECTORS},
+    {"detector", required_argument, NULL, OPT_DETECTOR},
+    {"sampled-sad", no_argument, NULL, OPT_SAMPLED_SAD},
+    {NULL, 0, NULL, 0}};
+
 void show_help(char **argv) {
   printf(
       "\nShotdetect version \"%s\", Copyright (c) 2007-2013 Johan Mathe\n\n"
@@ -62,7 +112,35 @@ void show_help(char **argv) {
       "-l           : generate last image for each shot\n"
       "-m           : generate the thumbnail image\n"
       "-r           : generate the images in native resolution\n"
-      "-c           : print timecode on x-axis in graph\n",
+      "-c           : print timecode on x-axis in graph\n"
+      "--max-memory MB : bound memory use, graph data and finished shots are\n"
+      "                  spilled to disk\n"
+      "--graph-width N : draw graphs N columns wide (min/max per column)\n"
+      "--graph-tiles   : also write graphs as a zoomable tile pyramid\n"
+      "--graph-chunks  : draw graphs in chunks during processing\n"
+      "--graph-svg     : write graphs as SVG instead of PNG\n"
+      "--lean          : detect shots only, no graphs and no video xml\n"
+      "--mjpeg         : encode images from the decoded frames with MJPEG\n"
+      "--thumb-sizes H,H,... : thumbnail heights (Default=84)\n"
+      "--sprite-sheet CxR : pack thumbnails into sheets of C columns, R rows\n"
+      "--pack          : write all images into one pack file with an index\n"
+      "--deferred-images : extract the shot images after detection\n"
+      "--tile-ratio R  : a cut needs a share R (0-1) of changed 8x8 tiles\n"
+      "--histogram PCT : detect cuts from colour histograms, PCT %% changed\n"
+      "--gradual T     : detect fades/dissolves, T = low threshold\n"
+      "--adaptive K[,N] : threshold at mean + K stddev of the last N frames\n"
+      "--flash-filter K : drop cuts whose picture comes back within K frames\n"
+      "--prefilter LEVEL : skip shot interiors from packet sizes and picture\n"
+      "                    types (1), and their non-reference frames (2)\n"
+      "--motion-vectors PCT : keep cuts in predicted pictures only when the\n"
+      "                       codec motion vectors score at least PCT\n"
+      "--detector D,D,... : cut detectors fused over one scan, the first one\n"
+      "                     decides (sad, planar, histogram, tile, mv;\n"
+      "                     mv cannot come first)\n"
+      "--sampled-sad   : with --lean only: estimate the difference from 1/8\n"
+      "                  of the rows, read frames entirely only near the\n"
+      "                  threshold; not exact, cuts confined to unsampled\n"
+      "                  rows can be missed\n",
       g_APP_VERSION, argv[0], DEFAULT_THRESHOLD);
 }
 
@@ -87,7 +165,8 @@ int main(int argc, char **argv) {
   f.set_draw_yuv_graph(false);  // YUV graph is still disabled, until it works.
 
   for (;;) {
-    int c = getopt(argc, argv, "?ht:y:i:o:a:x:s:flpwvmrc");
+    int c = getopt_long(argc, argv, "?ht:y:i:o:a:x:s:flpwvmrc", long_options,
+                        NULL);
 
     if (c < 0) {
       break;
@@ -182,6 +261,143 @@ int main(int argc, char **argv) {
         }
         break;
 
+      /* Bound memory use (MB) */
+      case OPT_MAX_MEMORY:
+        f.set_max_memory(max(0, atoi(optarg)));
+        break;
+
+      /* Decimate graphs to a fixed width */
+      case OPT_GRAPH_WIDTH:
+        f.set_graph_width(max(0, atoi(optarg)));
+        break;
+
+      /* Write graph tile pyramid */
+      case OPT_GRAPH_TILES:
+        f.set_graph_tiles(true);
+        break;
+
+      /* Draw graphs progressively */
+      case OPT_GRAPH_CHUNKS:
+        f.set_graph_chunks(true);
+        break;
+
+      /* Vector graphs */
+      case OPT_GRAPH_SVG:
+        f.set_graph_svg(true);
+        break;
+
+      /* Shot detection only */
+      case OPT_LEAN:
+        f.set_lean(true);
+        break;
+
+      /* Images straight from the decoder's YUV frames */
+      case OPT_MJPEG:
+        f.set_direct_jpeg(true);
+        break;
+
+      /* Thumbnail renditions */
+      case OPT_THUMB_SIZES: {
+        vector<int> heights;
+        istringstream sizes(optarg);
+        string size;
+        while (getline(sizes, size, ',')) {
+          if (atoi(size.c_str()) > 0) heights.push_back(atoi(size.c_str()));
+        }
+        if (heights.empty()) {
+          cerr << "ERROR: no valid height in --thumb-sizes " << optarg << endl;
+          exit(EXIT_FAILURE);
+        }
+        f.set_thumb_heights(heights);
+        break;
+      }
+
+      /* Thumbnails packed into sprite sheets */
+      case OPT_SPRITE_SHEET: {
+        int columns = 0, rows = 0;
+        if (sscanf(optarg, "%dx%d", &columns, &rows) != 2 || columns < 1 ||
+            rows < 1) {
+          cerr << "ERROR: --sprite-sheet expects COLUMNSxROWS, e.g. 10x10"
+               << endl;
+          exit(EXIT_FAILURE);
+        }
+        f.set_sheet_grid(columns, rows);
+        break;
+      }
+
+      /* All images in a single pack file */
+      case OPT_PACK:
+        f.set_pack_images(true);
+        break;
+
+      /* Images extracted in a second pass over the cut frames */
+      case OPT_DEFERRED_IMAGES:
+        f.set_deferred_images(true);
+        break;
+
+      /* Reject local changes with per-tile scores */
+      case OPT_TILE_RATIO:
+        f.set_tile_ratio(min(1.0, max(0.0, atof(optarg))));
+        break;
+
+      /* Colour histogram detector instead of the pixel difference */
+      case OPT_HISTOGRAM:
+        f.set_hist_threshold(min(100, max(0, atoi(optarg))));
+        break;
+
+      /* Twin-comparison gradual transition detection */
+      case OPT_GRADUAL:
+        f.set_gradual_threshold(max(0, atoi(optarg)));
+        break;
+
+      /* Threshold following the rolling score statistics */
+      case OPT_ADAPTIVE: {
+        double k = 0;
+        int window = 64;
+        if (sscanf(optarg, "%lf,%d", &k, &window) < 1 || k <= 0 ||
+            window < 8) {
+          cerr << "ERROR: --adaptive expects K[,N] with K > 0 and N >= 8, "
+                  "e.g. 3,64"
+               << endl;
+          exit(EXIT_FAILURE);
+        }
+        f.set_adaptive(k, window);
+        break;
+      }
+
+      /* Hold cuts back to recognize flashes and strobes */
+      case OPT_FLASH_FILTER:
+        f.set_flash_lookahead(min(100, max(0, atoi(optarg))));
+        break;
+
+      /* Compressed-domain pre-filter */
+      case OPT_PREFILTER:
+        f.set_prefilter(min(2, max(0, atoi(optarg))));
+        break;
+
+      /* Confirm cuts with the codec motion vectors */
+      case OPT_MOTION_VECTORS:
+        f.set_mv_threshold(min(100, max(0, atoi(optarg))));
+        break;
+
+      /* Detectors by name, checked against the registry */
+      case OPT_DETECTOR: {
+        detector::chain chain;
+        detector::settings none = {0, 0, 0, 0};
+        string error;
+        if (!chain.setup(optarg, none, error)) {
+          cerr << "ERROR: " << error << " in --detector " << optarg << endl;
+          exit(EXIT_FAILURE);
+        }
+        f.set_detectors(optarg);
+        break;
+      }
+
+      /* Estimate most frame differences from a sample of the rows */
+      case OPT_SAMPLED_SAD:
+        f.set_sampled_sad(true);
+        break;
+
       default:
         break;
     }
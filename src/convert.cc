@@ -0,0 +1,100 @@
+#include <convert.h>
+
+extern "C" {
+#   include <libavutil/imgutils.h>
+}
+
+namespace convert {
+
+cache::cache(): generation(0) {}
+
+cache::~cache() {
+    for (size_t i = 0; i < entries.size(); i++) {
+        sws_freeContext(entries[i]->sws);
+        av_frame_free(&entries[i]->own);
+    }
+}
+
+cache::entry *cache::find(AVFrame *src, AVPixelFormat format, int width,
+                          int height, int flags) {
+    const AVPixelFormat src_format = AVPixelFormat(src->format);
+    for (size_t i = 0; i < entries.size(); i++) {
+        entry *e = entries[i].get();
+        if (e->src_format == src_format && e->src_width == src->width &&
+            e->src_height == src->height && e->format == format &&
+            e->width == width && e->height == height && e->flags == flags) {
+            return e;
+        }
+    }
+
+    SwsContext *sws = sws_getContext(src->width, src->height, src_format,
+                                     width, height, format, flags, NULL, NULL,
+                                     NULL);
+    if (sws == NULL) {
+        return NULL;
+    }
+    std::unique_ptr<entry> e(new entry());
+    e->src_format = src_format;
+    e->src_width = src->width;
+    e->src_height = src->height;
+    e->format = format;
+    e->width = width;
+    e->height = height;
+    e->flags = flags;
+    e->sws = sws;
+    e->own = NULL;
+    e->last = NULL;
+    e->last_src = NULL;
+    e->last_generation = 0;
+    entries.push_back(std::move(e));
+    return entries.back().get();
+}
+
+AVFrame *cache::get(AVFrame *src, AVPixelFormat format, int width, int height,
+                    int flags, AVFrame *dst) {
+    entry *e = find(src, format, width, height, flags);
+    if (e == NULL) {
+        return NULL;
+    }
+    if (e->last != NULL && e->last_src == src->data[0] &&
+        e->last_generation == generation && (dst == NULL || dst == e->last)) {
+        return e->last;
+    }
+
+    if (dst == NULL) {
+        if (e->own == NULL) {
+            e->own = av_frame_alloc();
+            if (e->own == NULL) {
+                return NULL;
+            }
+            e->own->format = format;
+            e->own->width = width;
+            e->own->height = height;
+            if (av_frame_get_buffer(e->own, 32) < 0) {
+                av_frame_free(&e->own);
+                return NULL;
+            }
+        }
+        dst = e->own;
+    }
+    sws_scale(e->sws, src->data, src->linesize, 0, src->height, dst->data,
+              dst->linesize);
+    e->last = dst;
+    e->last_src = src->data[0];
+    e->last_generation = generation;
+    return dst;
+}
+
+size_t cache::memory_usage() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i]->own != NULL) {
+            bytes += av_image_get_buffer_size(entries[i]->format,
+                                              entries[i]->width,
+                                              entries[i]->height, 32);
+        }
+    }
+    return bytes;
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#   include <libavutil/frame.h>
+#   include <libswscale/swscale.h>
+}
+
+namespace convert
+{
+
+/*
+ * Pixel format conversions and scalings shared by every stage that needs
+ * them. One SwsContext is kept per source format and size, output format
+ * and size and scaler flags, and the last output of each is remembered:
+ * asking again for the same conversion of the same source frame returns
+ * it instead of converting twice. next_frame() must be called whenever a
+ * source buffer may hold a new picture.
+ */
+class cache {
+public:
+    cache();
+    ~cache();
+
+    inline void next_frame() { generation++; }
+
+    /*
+     * "src" converted to format at width x height. The result is written
+     * to "dst" when given, to a buffer owned by the cache otherwise; that
+     * one stays valid until the same conversion is asked for again.
+     * Returns NULL when the conversion is not possible.
+     */
+    AVFrame *get(AVFrame *src, AVPixelFormat format, int width, int height,
+                 int flags, AVFrame *dst = NULL);
+
+    size_t memory_usage() const;
+
+private:
+    struct entry {
+        AVPixelFormat src_format;
+        int src_width, src_height;
+        AVPixelFormat format;
+        int width, height;
+        int flags;
+        SwsContext *sws;
+        AVFrame *own;
+        // Last conversion: output, source picture and its generation
+        AVFrame *last;
+        uint8_t const *last_src;
+        unsigned long last_generation;
+    };
+
+    entry *find(AVFrame *src, AVPixelFormat format, int width, int height,
+                int flags);
+
+    std::vector<std::unique_ptr<entry> > entries;
+    unsigned long generation;
+};
+
+}
+
+#endif // CONVERT_H
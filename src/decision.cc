@@ -0,0 +1,148 @@
+#include <decision.h>
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace decision {
+
+rolling_stats::rolling_stats(size_t window)
+    : ring(window < 1 ? 1 : window), head(0), count(0), sum(0), sum_sq(0) {}
+
+void rolling_stats::push(double v) {
+    if (count == ring.size()) {
+        sum -= ring[head];
+        sum_sq -= ring[head] * ring[head];
+    } else {
+        count++;
+    }
+    ring[head] = v;
+    sum += v;
+    sum_sq += v * v;
+    head = (head + 1) % ring.size();
+}
+
+double rolling_stats::stddev() const {
+    if (count < 2) return 0;
+    const double m = sum / count;
+    const double var = sum_sq / count - m * m;
+    // Running sums can drift slightly below zero on constant input
+    return var > 0 ? sqrt(var) : 0;
+}
+
+double rolling_stats::median() const {
+    if (count == 0) return 0;
+    // The ring is full or filled from its start: its first "count" values
+    std::vector<double> values(ring.begin(), ring.begin() + count);
+    std::nth_element(values.begin(), values.begin() + count / 2, values.end());
+    return values[count / 2];
+}
+
+twin_comparison::twin_comparison(double low, double high, size_t window,
+                                 int max_gap, int min_length)
+    : low(low), high(high), max_gap(max_gap), min_length(min_length),
+      ring(window < 1 ? 1 : window), head(0), count(0), sum(0), open(false),
+      begin(0), end(0), gap(0) {
+    found.begin = found.end = 0;
+    found.strength = 0;
+}
+
+void twin_comparison::add(double score) {
+    if (count == ring.size()) {
+        sum -= ring[head];
+    } else {
+        count++;
+    }
+    ring[head] = score;
+    sum += score;
+    head = (head + 1) % ring.size();
+}
+
+bool twin_comparison::close() {
+    open = false;
+    if (end - begin + 1 < min_length || sum < high) {
+        return false;
+    }
+    found.begin = begin;
+    found.end = end;
+    found.strength = sum;
+    return true;
+}
+
+bool twin_comparison::push(int frame, double score, bool cut) {
+    if (cut) {
+        open = false;
+        return false;
+    }
+    if (score > low) {
+        if (!open) {
+            open = true;
+            begin = frame;
+            head = count = 0;
+            sum = 0;
+        }
+        add(score);
+        end = frame;
+        gap = 0;
+        return false;
+    }
+    if (!open) {
+        return false;
+    }
+    if (++gap > max_gap) {
+        return close();
+    }
+    add(score);
+    return false;
+}
+
+bool twin_comparison::finish() {
+    return open && close();
+}
+
+flash_filter::flash_filter(int lookahead)
+    : lookahead(lookahead), held(false), frame(0), age(0), done(0), score(0),
+      flashes(0) {}
+
+void flash_filter::hold(int frame, double score) {
+    held = true;
+    this->frame = frame;
+    this->score = score;
+    age = 0;
+}
+
+bool flash_filter::push(int frame, double score, bool cut, similarity back) {
+    if (!held) {
+        if (cut) hold(frame, score);
+        return false;
+    }
+    age++;
+    const bool returned =
+        back == SAME || (back == UNKNOWN && cut && score >= this->score / 2 &&
+                         score <= this->score * 2);
+    if (returned) {
+        held = false;
+        flashes++;
+        return false;
+    }
+    if (cut) {
+        done = this->frame;
+        hold(frame, score);
+        return true;
+    }
+    if (age >= lookahead) {
+        done = this->frame;
+        held = false;
+        return true;
+    }
+    return false;
+}
+
+bool flash_filter::finish() {
+    if (!held) return false;
+    done = frame;
+    held = false;
+    return true;
+}
+
+}
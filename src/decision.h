@@ -0,0 +1,119 @@
+#ifndef DECISION_H
+#define DECISION_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace decision
+{
+
+/*
+ * A gradual transition (fade, dissolve, wipe) between two shots
+ */
+struct transition {
+    int begin, end;   // first and last frame
+    double strength;  // accumulated frame difference
+};
+
+/*
+ * Mean and standard deviation of the last "window" values, from running
+ * sums over a ring: constant time per value. The median is taken from the
+ * ring when asked for.
+ */
+class rolling_stats {
+public:
+    explicit rolling_stats(size_t window = 64);
+
+    void push(double v);
+
+    inline size_t size() const { return count; }
+    inline double mean() const { return count ? sum / count : 0; }
+    double stddev() const;
+    double median() const;
+
+private:
+    std::vector<double> ring;
+    size_t head, count;
+    double sum, sum_sq;
+};
+
+/*
+ * Twin-comparison detector for gradual transitions. A frame difference
+ * over the low threshold opens a candidate, whose differences are summed
+ * over its last "window" frames, kept in a ring so each frame costs O(1).
+ * The candidate ends after more than "max_gap" frames under the low
+ * threshold, and is a transition when it lasted "min_length" frames and
+ * its sum reached the high (hard cut) threshold. A hard cut drops it.
+ */
+class twin_comparison {
+public:
+    twin_comparison(double low = 0, double high = 0, size_t window = 64,
+                    int max_gap = 2, int min_length = 3);
+
+    /*
+     * Difference "score" of "frame" with the previous one, "cut" if it was
+     * detected as a hard cut. Returns true when a transition is complete,
+     * see last().
+     */
+    bool push(int frame, double score, bool cut);
+    /* End of the stream, completes an open candidate */
+    bool finish();
+
+    inline transition const &last() const { return found; }
+
+private:
+    void add(double score);
+    bool close();
+
+    double low, high;
+    int max_gap, min_length;
+    std::vector<double> ring;
+    size_t head, count;
+    double sum;
+    bool open;
+    int begin, end, gap;
+    transition found;
+};
+
+/*
+ * Flash and strobe suppression. A cut is held back for up to "lookahead"
+ * frames, and dropped together with the return when the picture comes
+ * back within that delay (A -> B -> A). Whether it came back is told by
+ * the caller from a frame summary when there is one, otherwise guessed
+ * from the scores: a second spike of similar size. Only one cut is held at
+ * a time, so memory does not depend on the delay.
+ */
+class flash_filter {
+public:
+    enum similarity { UNKNOWN = -1, DIFFERENT = 0, SAME = 1 };
+
+    explicit flash_filter(int lookahead = 0);
+
+    /*
+     * Score and raw cut decision of "frame"; "back" compares it with the
+     * frame before the held cut. Returns true when the held cut is
+     * confirmed, see confirmed(). A cut that is not a flash return becomes
+     * the held one, check held_frame().
+     */
+    bool push(int frame, double score, bool cut, similarity back);
+    /* End of the stream, confirms the held cut */
+    bool finish();
+
+    inline bool holding() const { return held; }
+    inline int held_frame() const { return frame; }
+    inline int confirmed() const { return done; }
+    inline size_t suppressed() const { return flashes; }
+
+private:
+    void hold(int frame, double score);
+
+    int lookahead;
+    bool held;
+    int frame, age, done;
+    double score;
+    size_t flashes;
+};
+
+}
+
+#endif // DECISION_H
@@ -0,0 +1,230 @@
+#include <detector.h>
+
+#include <sstream>
+#include <utility>
+
+namespace detector {
+
+namespace {
+
+/* Mean absolute pixel difference, the historical detector */
+class sad: public detector {
+public:
+    explicit sad(settings const &s): limit(s.threshold) {}
+
+    unsigned features() const { return kernels::SAD; }
+    double score(frame const &cur, frame const &) const {
+        return cur.pixels.diff.abs_norm_diff;
+    }
+    double threshold() const { return limit; }
+
+private:
+    double limit;
+};
+
+/*
+ * The same difference from the decoded YUV planes at their own bit depth,
+ * without the RGB conversion, weighted back into RGB units so that it
+ * shares the sad threshold
+ */
+class planar: public detector {
+public:
+    explicit planar(settings const &s): limit(s.threshold) {}
+
+    unsigned features() const { return kernels::PLANES; }
+    double score(frame const &cur, frame const &) const {
+        return cur.planes.abs_norm_diff;
+    }
+    double threshold() const { return limit; }
+
+private:
+    double limit;
+};
+
+/* Percentage of pixels whose colour bin changed */
+class histogram: public detector {
+public:
+    explicit histogram(settings const &s)
+        : limit(s.hist_threshold > 0 ? s.hist_threshold : DEFAULT_HIST_THRESHOLD) {}
+
+    unsigned features() const { return kernels::HISTOGRAM; }
+    double score(frame const &cur, frame const &prev) const {
+        return 100 * processing::histogram_difference(cur.pixels.hist, prev.pixels.hist);
+    }
+    double threshold() const { return limit; }
+
+private:
+    double limit;
+};
+
+/* Percentage of 8x8 tiles whose own difference is over the threshold */
+class tile: public detector {
+public:
+    explicit tile(settings const &s)
+        : tile_threshold(s.threshold),
+          ratio(s.tile_ratio > 0 ? s.tile_ratio : DEFAULT_TILE_RATIO) {}
+
+    unsigned features() const { return kernels::TILES; }
+    double score(frame const &cur, frame const &) const {
+        processing::TileDiff const &t = cur.pixels.tiles;
+        return t.tiles.empty() ? 0 : 100.0 * t.changed(tile_threshold) / t.tiles.size();
+    }
+    double threshold() const { return 100 * ratio; }
+    bool confirms(frame const &cur, frame const &prev) const {
+        return score(cur, prev) >= threshold();
+    }
+
+private:
+    double tile_threshold;
+    double ratio;
+};
+
+/*
+ * Motion vector score. Intra pictures have no vectors: they score 0 and
+ * do not veto a cut found by another detector, but this detector cannot
+ * find the cuts itself.
+ */
+class mv: public detector {
+public:
+    explicit mv(settings const &s)
+        : limit(s.mv_threshold > 0 ? s.mv_threshold : DEFAULT_MV_THRESHOLD) {}
+
+    unsigned features() const { return 0; }
+    bool uses_motion() const { return true; }
+    bool can_decide() const { return false; }
+    double score(frame const &cur, frame const &) const {
+        return cur.motion.valid ? cur.motion.score() : 0;
+    }
+    double threshold() const { return limit; }
+    bool confirms(frame const &cur, frame const &prev) const {
+        return !cur.motion.valid || score(cur, prev) >= threshold();
+    }
+
+private:
+    double limit;
+};
+
+template <typename T>
+std::shared_ptr<detector> make(settings const &s) {
+    return std::make_shared<T>(s);
+}
+
+typedef std::vector<std::pair<std::string, factory> > registry;
+
+registry &detectors() {
+    static registry all;
+    if (all.empty()) {
+        all.push_back(std::make_pair("sad", &make<sad>));
+        all.push_back(std::make_pair("planar", &make<planar>));
+        all.push_back(std::make_pair("histogram", &make<histogram>));
+        all.push_back(std::make_pair("tile", &make<tile>));
+        all.push_back(std::make_pair("mv", &make<mv>));
+    }
+    return all;
+}
+
+}
+
+void register_detector(std::string const &name, factory make) {
+    registry &all = detectors();
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i].first == name) {
+            all[i].second = make;
+            return;
+        }
+    }
+    all.push_back(std::make_pair(name, make));
+}
+
+std::vector<std::string> names() {
+    std::vector<std::string> out;
+    registry const &all = detectors();
+    for (size_t i = 0; i < all.size(); i++) {
+        out.push_back(all[i].first);
+    }
+    return out;
+}
+
+std::shared_ptr<detector> create(std::string const &name, settings const &s) {
+    registry const &all = detectors();
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i].first == name) return all[i].second(s);
+    }
+    return std::shared_ptr<detector>();
+}
+
+chain::chain(): mask(0), motion(false) {
+    cur.pixels.mask = prev.pixels.mask = 0;
+    cur.motion.valid = prev.motion.valid = false;
+    cur.planes.abs_norm_diff = prev.planes.abs_norm_diff = 0;
+}
+
+bool chain::setup(std::string const &list, settings const &s, std::string &error) {
+    detectors.clear();
+    mask = 0;
+    motion = false;
+    std::istringstream in(list);
+    std::string name;
+    while (std::getline(in, name, ',')) {
+        std::shared_ptr<detector> d = create(name, s);
+        if (!d) {
+            error = "unknown detector \"" + name + "\"";
+            return false;
+        }
+        if (detectors.empty() && !d->can_decide()) {
+            error = "detector \"" + name +
+                    "\" does not score every frame and cannot come first";
+            return false;
+        }
+        detectors.push_back(d);
+        mask |= d->features();
+        motion = motion || d->uses_motion();
+    }
+    if (detectors.empty()) {
+        error = "no detector";
+        return false;
+    }
+    return true;
+}
+
+void chain::prime(AVFrame const *rgb) {
+    // Only what is kept from frame to frame: the pixels are read again
+    if (mask & kernels::HISTOGRAM) {
+        prev.pixels = processing::scan_frame(rgb, NULL, kernels::HISTOGRAM);
+    }
+    prev.motion.valid = false;
+}
+
+void chain::analyse(AVFrame const *rgb, AVFrame const *prev_rgb,
+                    AVFrame const *decoded, AVFrame const *prev_decoded,
+                    processing::MotionStats const &mvs, bool averages) {
+    const unsigned features = (mask & kernels::ALL) | (averages ? kernels::AVERAGES : 0);
+    if (features != 0) {
+        cur.pixels = processing::scan_frame(rgb, prev_rgb, features);
+    }
+    if (mask & kernels::PLANES) {
+        cur.planes = processing::planar_frame_difference(decoded, prev_decoded);
+    }
+    cur.motion = mvs;
+}
+
+double chain::score() const {
+    return detectors[0]->score(cur, prev);
+}
+
+double chain::threshold() const {
+    return detectors[0]->threshold();
+}
+
+bool chain::confirmed() const {
+    for (size_t i = 1; i < detectors.size(); i++) {
+        if (!detectors[i]->confirms(cur, prev)) return false;
+    }
+    return true;
+}
+
+void chain::advance() {
+    std::swap(cur, prev);
+}
+
+}
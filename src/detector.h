@@ -0,0 +1,129 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <kernels.h>
+#include <processing.h>
+
+namespace detector
+{
+
+/*
+ * Thresholds of the built-in detectors, a value of 0 taking the default
+ */
+struct settings {
+    int threshold;        // sad: mean absolute difference per pixel
+    int hist_threshold;   // histogram: percent of pixels changing bin
+    double tile_ratio;    // tile: share of tiles over "threshold"
+    int mv_threshold;     // mv: motion vector score
+};
+
+static const int DEFAULT_HIST_THRESHOLD = 40;
+static const double DEFAULT_TILE_RATIO = 0.25;
+static const int DEFAULT_MV_THRESHOLD = 40;
+
+/*
+ * What a detector sees of a frame: the pixel features of one scan, the
+ * difference of the decoded planes and the motion vectors the decoder
+ * exported
+ */
+struct frame {
+    processing::FrameFeatures pixels;
+    processing::FrameDiff planes;
+    processing::MotionStats motion;
+};
+
+/*
+ * A cut detector: the pixel features it needs extracted, and a decision
+ * on the current frame against the previous one
+ */
+class detector {
+public:
+    virtual ~detector() {}
+
+    /* kernels::feature mask of the pixel features read */
+    virtual unsigned features() const = 0;
+    /* Whether the motion vectors are read */
+    virtual bool uses_motion() const { return false; }
+    /*
+     * Whether every frame gets a meaningful score, so that this detector
+     * can come first in a chain and find the cuts
+     */
+    virtual bool can_decide() const { return true; }
+
+    virtual double score(frame const &cur, frame const &prev) const = 0;
+    virtual double threshold() const = 0;
+    /*
+     * Fused behind another detector: whether a cut that one found stands.
+     * By default when this detector's own score is over its threshold.
+     */
+    virtual bool confirms(frame const &cur, frame const &prev) const {
+        return score(cur, prev) > threshold();
+    }
+};
+
+typedef std::shared_ptr<detector> (*factory)(settings const &s);
+
+/* Make a detector available under "name" */
+void register_detector(std::string const &name, factory make);
+/* Registered names: sad, planar, histogram, tile and mv are built in */
+std::vector<std::string> names();
+/* The detector registered as "name", empty if there is none */
+std::shared_ptr<detector> create(std::string const &name, settings const &s);
+
+/*
+ * Detectors fused over one scan of each frame. The first one scores the
+ * frames and finds the cuts, each of the others has to confirm them.
+ */
+class chain {
+public:
+    chain();
+
+    /*
+     * "sad,tile,...": false with "error" set on an unknown name, or on a
+     * first detector that cannot decide
+     */
+    bool setup(std::string const &list, settings const &s, std::string &error);
+
+    inline size_t size() const { return detectors.size(); }
+    inline detector const &primary() const { return *detectors[0]; }
+    inline unsigned features() const { return mask; }
+    inline bool uses_motion() const { return motion; }
+
+    /*
+     * Take "rgb" as the previous frame without comparing it, for the first
+     * frame or one whose analysis was skipped
+     */
+    void prime(AVFrame const *rgb);
+    /*
+     * Features of "rgb" in one scan, "prev_rgb" being the previous frame
+     * (only read for sad and tile); channel averages when "averages". The
+     * decoded frames are only read by planar.
+     */
+    void analyse(AVFrame const *rgb, AVFrame const *prev_rgb,
+                 AVFrame const *decoded, AVFrame const *prev_decoded,
+                 processing::MotionStats const &mvs, bool averages);
+    /* Score and threshold of the first detector, after analyse() */
+    double score() const;
+    double threshold() const;
+    /* Whether every other detector confirms a cut on the analysed frame */
+    bool confirmed() const;
+    /* The analysed frame becomes the previous one */
+    void advance();
+
+    inline frame const &current() const { return cur; }
+    inline frame const &previous() const { return prev; }
+
+private:
+    std::vector<std::shared_ptr<detector> > detectors;
+    unsigned mask;
+    bool motion;
+    frame cur, prev;
+};
+
+}
+
+#endif // DETECTOR_H
@@ -24,16 +24,21 @@
 #include <ui/dialog_shotdetect.h>
 #endif
 
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <time.h>
 extern "C" {
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 }
+#include <convert.h>
 #include <film.h>
 #include <graph.h>
 #include <format.h>
 #include <processing.h>
+#include <algorithm>
+#include <future>
+#include <sstream>
 #include <thread>
 
 #define DEBUG
@@ -76,6 +81,101 @@ void film::do_stats(int frame_number)
   show_started = 1;
 }
 
+/*
+ * Bytes held by one shot and its images
+ */
+size_t film::shot_memory(const shot &s) {
+  // list<shot> node: payload plus two links
+  size_t bytes = sizeof(shot) + 2 * sizeof(void *);
+  const image *images[] = {s.img_begin, s.img_end};
+  for (int i = 0; i < 2; i++) {
+    if (images[i] != NULL) {
+      bytes += sizeof(image) + images[i]->img.capacity() +
+               images[i]->thumbs.capacity() * sizeof(image::rendition);
+      for (size_t t = 0; t < images[i]->thumbs.size(); t++) {
+        bytes += images[i]->thumbs[t].src.capacity();
+      }
+    }
+  }
+  return bytes;
+}
+
+/*
+ * Estimate the memory held by each subsystem. The per-frame graph series
+ * and the shot list grow with the film duration, the decoder frames only
+ * with the resolution. The finished shots are counted as they are added,
+ * so this does not depend on their number.
+ */
+film::memory_usage film::get_memory_usage() {
+  memory_usage usage;
+  usage.graph = g ? g->memory_usage() : 0;
+  usage.shots = shots_memory + (shots.empty() ? 0 : shot_memory(shots.back()));
+
+  usage.frames = 0;
+  if (videoStream != -1) {
+    usage.frames = (keep_prev_rgb ? 2 : 1) * av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, 32) +
+                   av_image_get_buffer_size(AV_PIX_FMT_YUV444P, width, height, 32);
+    if (conversions != NULL) usage.frames += conversions->memory_usage();
+  }
+
+  struct rusage self;
+  getrusage(RUSAGE_SELF, &self);
+  usage.peak_rss = self.ru_maxrss;
+  return usage;
+}
+
+/*
+ * Bounded memory mode: over the budget, move every finished shot, with its
+ * images, to the scratch file. Only the current shot stays in memory.
+ */
+void film::bound_shots() {
+  // Deferred images are still to be written through their pointers
+  if (spill_failed || deferred_images || shots.size() < 2) return;
+  memory_usage usage = get_memory_usage();
+  if (usage.graph + usage.shots + usage.frames <= max_memory) return;
+
+  if (!spilled_shots.is_open() &&
+      !spilled_shots.open(global_path + "/" + alphaid + "/shots.spill")) {
+    shotlog("Cannot create the shot spill file, shots stay in memory");
+    spill_failed = true;
+    return;
+  }
+  while (shots.size() > 1) {
+    shot &s = shots.front();
+    if (!spilled_shots.append(s)) {
+      shotlog("Cannot write the shot spill file, shots stay in memory");
+      spill_failed = true;
+      return;
+    }
+    shots_memory -= shot_memory(s);
+    delete s.img_begin;
+    delete s.img_end;
+    shots.pop_front();
+  }
+}
+
+void film::for_each_shot(const function<void(shot &)> &visit) {
+  if (spilled_shots.size() > 0 && spilled_shots.rewind()) {
+    shot s;
+    for (size_t i = 0; i < spilled_shots.size() && spilled_shots.read(s, this);
+         i++) {
+      visit(s);
+      delete s.img_begin;
+      delete s.img_end;
+    }
+  }
+  for (list<shot>::iterator il = shots.begin(); il != shots.end(); il++) {
+    visit(*il);
+  }
+}
+
+void film::log_memory_usage() {
+  memory_usage usage = get_memory_usage();
+  this->shotlog(fmt::format("Memory: graph={} KiB, shots={} KiB, frames={} KiB, peak RSS={} KiB",
+                            usage.graph / 1024, usage.shots / 1024,
+                            usage.frames / 1024, usage.peak_rss));
+}
+
 void film::create_main_dir() {
   ostringstream str;
   struct stat *buf;
@@ -92,11 +192,159 @@ void film::create_main_dir() {
   }
 }
 
+/*
+ * Write a shot image now, or in deferred mode only record which frame it
+ * is taken from: the begin image of a cut is the current frame, the end
+ * image the previous one.
+ */
+void film::save_image(image *im, AVFrame *rgb, AVFrame *decoded,
+                      int frame_number) {
+  if (deferred_images) {
+    if (im->type == BEGIN) {
+      defer_image(im, cur_index, cur_pts, frame_number);
+    } else {
+      defer_image(im, prev_index, prev_pts, frame_number);
+    }
+    return;
+  }
+  write_image(im, rgb, decoded, frame_number);
+}
+
+/*
+ * Record an image to extract from decoded frame "index" after detection
+ */
+void film::defer_image(image *im, int index, int64_t pts, int frame_number) {
+  extraction e;
+  e.im = im;
+  e.index = index;
+  e.pts = pts;
+  e.frame_number = frame_number;
+  e.written = false;
+  extractions.push_back(e);
+}
+
+/*
+ * Write a shot image, from the decoded frame with direct JPEG output or
+ * from its RGB conversion through gd otherwise
+ */
+void film::write_image(image *im, AVFrame *rgb, AVFrame *decoded,
+                       int frame_number) {
+  if (jpeg_out != NULL) {
+    im->SaveFrame(jpeg_out, decoded, frame_number);
+  } else {
+    im->SaveFrame(rgb, frame_number);
+  }
+}
+
+/*
+ * Sprite sheet mode: one sheet series per thumbnail height, in
+ * <alphaid>/sheets/, or in the pack under that name
+ */
+void film::open_sheets() {
+  string dir = this->global_path + "/" + this->alphaid + "/sheets";
+  if (image_pack != NULL) {
+    dir = this->alphaid + "/sheets";
+  } else {
+    struct stat buf;
+    if (stat(dir.c_str(), &buf) == -1) {
+#if defined(__WINDOWS__) || defined(__MINGW32__)
+      mkdir(dir.c_str());
+#else
+      mkdir(dir.c_str(), 0777);
+#endif
+    }
+  }
+  for (size_t i = 0; i < thumb_heights.size(); i++) {
+    const int h = thumb_heights[i];
+    thumb_sheets.push_back(new sprite::sheet(
+        dir, fmt::format("{}_{}", alphaid, h), sheet_columns, sheet_rows,
+        max(1, (h * width) / height), h, image_pack));
+  }
+}
+
+/*
+ * Write the last sheets and the index of every thumbnail:
+ * <alphaid>/sheets/index.json, or <alphaid>/sheets.json when the sheets
+ * are in the pack
+ */
+void film::close_sheets() {
+  if (thumb_sheets.empty()) return;
+  for (size_t i = 0; i < thumb_sheets.size(); i++) {
+    sprite::sheet *sheet = thumb_sheets[i];
+    const string name = alphaid + "/sheets/" + sheet->file_name(sheet->index());
+    if (!sheet->flush()) image::store_failed(this, name);
+  }
+
+  string path = this->global_path + "/" + this->alphaid +
+                (image_pack != NULL ? "/sheets.json" : "/sheets/index.json");
+  FILE *fd = fopen(path.c_str(), "w");
+  if (fd == NULL) {
+    shotlog("Cannot write sprite sheet index " + path);
+  } else {
+    fmt::print(fd, "{{\n  \"columns\": {},\n  \"rows\": {},\n  \"thumbs\": [",
+               sheet_columns, sheet_rows);
+    const char *sep = "\n";
+    for_each_shot([&](shot &s) {
+      image *images[] = {s.img_begin, s.img_end};
+      const char *types[] = {"in", "out"};
+      for (int i = 0; i < 2; i++) {
+        if (images[i] == NULL) continue;
+        for (size_t t = 0; t < images[i]->thumbs.size(); t++) {
+          const image::rendition &r = images[i]->thumbs[t];
+          if (r.sheet < 0) continue;
+          fmt::print(fd,
+                     "{}    {{\"shot\": {}, \"type\": \"{}\", \"size\": {}, "
+                     "\"sheet\": \"{}\", \"x\": {}, \"y\": {}, \"w\": {}, "
+                     "\"h\": {}}}",
+                     sep, s.myid, types[i], thumb_heights[t], r.src, r.x, r.y,
+                     r.width, r.height);
+          sep = ",\n";
+        }
+      }
+    });
+    fmt::print(fd, "\n  ]\n}}\n");
+    fclose(fd);
+  }
+
+  for (size_t i = 0; i < thumb_sheets.size(); i++) {
+    delete thumb_sheets[i];
+  }
+  thumb_sheets.clear();
+}
+
+/*
+ * Pack mode: every shot image and thumbnail is appended to
+ * <alphaid>/<alphaid>.pack instead of a file of its own
+ */
+void film::open_pack() {
+  string path = this->global_path + "/" + this->alphaid + "/" + alphaid +
+                ".pack";
+  image_pack = new pack::writer();
+  if (!image_pack->open(path)) {
+    cerr << path << endl;
+    perror("shotdetect ");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * Write the pack index
+ */
+void film::close_pack() {
+  if (image_pack == NULL) return;
+  if (!image_pack->close()) {
+    shotlog("Cannot write the image pack index");
+  }
+  delete image_pack;
+  image_pack = NULL;
+}
+
 void film::get_yuv_colors(AVFrame &pFrame) {
     // If graphing is enabled, compute YUV averages and report them
     if(this->draw_yuv_graph){
         auto yuv_average = processing::get_yuv_colors(pFrame);
         g->push_yuv(yuv_average);
+        graph_yuv = yuv_average;
     }
 }
 
@@ -107,85 +355,286 @@ void film::get_yuv_colors(AVFrame &pFrame) {
  * for this scene cut.
  */
 void film::CompareFrame(AVFrame *pFrame, AVFrame *pFramePrev) {
-  const int frame_number = pCodecCtx->frame_number;
-  bool graphing_enabled = this->draw_rgb_graph || this->draw_hsv_graph;
+  const int frame_number = cur_index;
+  bool graphing_enabled =
+      g != NULL && (this->draw_rgb_graph || this->draw_hsv_graph);
 
-  processing::FrameDiff frame_diff = processing::abs_frame_difference(pFrame, pFramePrev, graphing_enabled);
-  auto score = frame_diff.abs_norm_diff;
+  /*
+   * The selected detectors read their features from one scan of the
+   * frame; the first one scores it and the others confirm its cuts
+   */
+  double cut_threshold = detection.threshold();
+  double score = 0;
+  double bound = 0;
+
+  /*
+   * Sampled SAD: the rows of a few bands tell most frames are far under
+   * the threshold; only the others are read entirely. The bound and the
+   * tenth of the threshold are a statistical margin, not a proof: the
+   * rows that are not read can still hold a cut.
+   */
+  if (sampling) {
+    const processing::DiffEstimate est =
+        processing::sampled_frame_difference(pFrame, pFramePrev);
+    const double margin = est.bound + 0.1 * cut_threshold;
+    sampled_frames++;
+    if (est.mean + margin < cut_threshold) {
+      score = est.mean;
+      bound = margin;
+    }
+  }
+  if (bound == 0) {
+    detection.analyse(pFrame, pFramePrev, this->pFrame, pFramePrevDecoded,
+                      motion, graphing_enabled);
+    score = detection.score();
+    if (sampling) sampled_exact++;
+  }
+  processing::FrameDiff const &frame_diff = detection.current().pixels.diff;
+
+  /*
+   * A frame over the threshold after an estimated one: when the estimate
+   * leaves the difference on both sides of the threshold, score the
+   * previous frame exactly against the one before it
+   */
+  if (bound == 0 && prev_bound > 0 && score > cut_threshold &&
+      score - (prev_score - prev_bound) > cut_threshold &&
+      score - (prev_score + prev_bound) <= cut_threshold) {
+    prev_score = processing::abs_frame_difference(pFramePrev, pFrameRGBprev2,
+                                                  false).abs_norm_diff;
+    sampled_exact++;
+  }
 
   /*
    * Calculate numerical difference between this and the previous frame
    */
   const double diff = abs(score - prev_score);
   prev_score = score;
+  prev_bound = bound;
 
   /*
    * Store gathered data
    */
-  g->push_data(score);
+  if (g != NULL) {
+    g->push_data(score);
+    graph_score = score;
+  }
   if(graphing_enabled){
     g->push_rgb(frame_diff.c1avg, frame_diff.c2avg, frame_diff.c3avg);
     g->push_rgb_to_hsv(frame_diff.c1avg, frame_diff.c2avg, frame_diff.c3avg);
+    graph_rgb[0] = frame_diff.c1avg;
+    graph_rgb[1] = frame_diff.c2avg;
+    graph_rgb[2] = frame_diff.c3avg;
   }
 
   /*
-   * Take care of storing frame position and images of detected scene cut
+   * Adaptive mode: the threshold follows the recent scores, with a floor
+   * at a quarter of the fixed one so still scenes do not cut on noise
    */
-  if ((diff > this->threshold) && (score > this->threshold)) {
-    shot s;
-    s.fbegin = frame_number;
-    s.msbegin = int((frame_number * 1000) / fps);
-    s.myid = shots.back().myid + 1;
+  if (adaptive_k > 0 && score_stats.size() >= 8) {
+    cut_threshold = max(cut_threshold / 4,
+                        score_stats.mean() + adaptive_k * score_stats.stddev());
+  }
 
-    this->log_progress("shot", s.msbegin, duration.mstotal);
+  bool cut = (diff > cut_threshold) && (score > cut_threshold);
+  if (cut && !detection.confirmed()) {
+    cut = false;
+    vetoed_cuts++;
+  }
+  if (adaptive_k > 0 && !cut) {
+    score_stats.push(score);
+  }
 
-    /*
-     * Convert to ms
-     */
-    shots.back().fduration = frame_number - shots.back().fbegin;
-    shots.back().msduration = int(((shots.back().fduration) * 1000) / fps);
+  /*
+   * Gradual transitions are accumulated from the same per-frame score
+   */
+  if (gradual_threshold > 0 && gradual.push(frame_number, score, cut)) {
+    transitions.push_back(gradual.last());
+  }
+
+  /*
+   * Take care of storing frame position and images of detected scene cut.
+   * The flash filter holds a cut back for a few frames and drops it when
+   * the picture comes back; the histogram before the held cut tells that
+   * when there is one.
+   */
+  const cut_point current = {frame_number, cur_index, prev_index, cur_pts,
+                             prev_pts};
+  if (flash_lookahead > 0) {
+    decision::flash_filter::similarity back = decision::flash_filter::UNKNOWN;
+    if (flashes.holding() && (detection.features() & kernels::HISTOGRAM)) {
+      double same = cut_threshold;
+      if (!(detection.primary().features() & kernels::HISTOGRAM)) {
+        same = hist_threshold > 0 ? hist_threshold
+                                  : detector::DEFAULT_HIST_THRESHOLD;
+      }
+      back = 100 * processing::histogram_difference(
+                       detection.current().pixels.hist, held_hist) < same
+                 ? decision::flash_filter::SAME
+                 : decision::flash_filter::DIFFERENT;
+    }
+    if (flashes.push(frame_number, score, cut, back)) {
+      add_cut(held_cut, NULL, NULL);
+    }
+    if (flashes.holding() && flashes.held_frame() == frame_number) {
+      held_cut = current;
+      if (detection.features() & kernels::HISTOGRAM) {
+        held_hist = detection.previous().pixels.hist;
+      }
+    }
+  } else if (cut) {
+    add_cut(current, pFrame, pFramePrev);
+  }
+
+  detection.advance();
+}
+
+/*
+ * Start a new shot at cut "c". The RGB frames are those of the cut and of
+ * the frame before, when it is the current one; a cut confirmed later has
+ * its images extracted after detection.
+ */
+void film::add_cut(const cut_point &c, AVFrame *rgb, AVFrame *rgb_prev) {
+  const int frame_number = c.frame_number;
+  shot s;
+  s.fbegin = frame_number;
+  s.msbegin = int((frame_number * 1000) / fps);
+  s.myid = shots.back().myid + 1;
+
+  this->log_progress("shot", s.msbegin, duration.mstotal);
+
+  /*
+   * Convert to ms
+   */
+  shots.back().fduration = frame_number - shots.back().fbegin;
+  shots.back().msduration = int(((shots.back().fduration) * 1000) / fps);
 
 /*
  * Create images if necessary
  */
 #ifdef WXWIDGETS
-    if (this->first_img_set ||
-        (display && dialogParent->checkbox_1->GetValue()))
+  if (this->first_img_set ||
+      (display && dialogParent->checkbox_1->GetValue()))
 #else
-    if (this->first_img_set)
+  if (this->first_img_set)
 #endif
-    {
-      image *im_begin = new image(this, width, height, s.myid, BEGIN,
-                                  this->thumb_set, this->shot_set);
-      im_begin->SaveFrame(pFrame, frame_number);
-      s.img_begin = im_begin;
+  {
+    image *im_begin = new image(this, width, height, s.myid, BEGIN,
+                                this->thumb_set, this->shot_set);
+    if (deferred_images) {
+      defer_image(im_begin, c.index, c.pts, frame_number);
+    } else {
+      write_image(im_begin, rgb, this->pFrame, frame_number);
     }
+    s.img_begin = im_begin;
+  }
 
 #ifdef WXWIDGETS
-    if (this->last_img_set || (display && dialogParent->checkbox_2->GetValue()))
+  if (this->last_img_set || (display && dialogParent->checkbox_2->GetValue()))
 #else
-    if (this->last_img_set)
+  if (this->last_img_set)
 #endif
-    {
-      image *im_end = new image(this, width, height, s.myid - 1, END,
-                                this->thumb_set, this->shot_set);
-      im_end->SaveFrame(pFramePrev, frame_number);
-      shots.back().img_end = im_end;
+  {
+    image *im_end = new image(this, width, height, s.myid - 1, END,
+                              this->thumb_set, this->shot_set);
+    if (deferred_images) {
+      defer_image(im_end, c.prev_index, c.prev_pts, frame_number);
+    } else {
+      write_image(im_end, rgb_prev, pFramePrevDecoded, frame_number);
     }
-    shots.push_back(s);
+    shots.back().img_end = im_end;
+  }
+  // The shot that ends here no longer changes
+  shots_memory += shot_memory(shots.back());
+  shots.push_back(s);
+  if (max_memory) bound_shots();
 
 /*
  * updating display
  */
 #ifdef WXWIDGETS
-    wxString nbshots;
-    nbshots << shots.size();
-    if (display) {
-      wxMutexGuiEnter();
-      dialogParent->list_films->SetItem(0, 1, nbshots);
-      wxMutexGuiLeave();
-    }
+  wxString nbshots;
+  nbshots << shots.size();
+  if (display) {
+    wxMutexGuiEnter();
+    dialogParent->list_films->SetItem(0, 1, nbshots);
+    wxMutexGuiLeave();
+  }
 #endif
+}
+
+/*
+ * Compressed-domain pre-filter: whether the pixels of "frame" must be
+ * analysed. Keyframes, I pictures and packets half again as large as the
+ * median of the recent ones of the same picture type may be cuts, and so
+ * may the frames after them, as many as the decoder delays its output at
+ * level 2; anything else is taken as a shot interior. A frame is analysed
+ * anyway after PERIOD skipped ones, for the cuts the packets do not show.
+ * At level 2 the decoder also drops non-reference frames while nothing is
+ * suspicious.
+ */
+bool film::prefilter_frame(AVFrame *frame) {
+  static const int PERIOD = 12;
+  static const double SIZE_RATIO = 1.5;
+  const int size = av_frame_get_pkt_size(frame);
+  decision::rolling_stats &sizes =
+      packet_sizes[frame->pict_type == AV_PICTURE_TYPE_B ? 1 : 0];
+  const bool suspicious =
+      frame->key_frame || frame->pict_type == AV_PICTURE_TYPE_I || size < 0 ||
+      sizes.size() < 8 || size > SIZE_RATIO * sizes.median();
+  if (!frame->key_frame && size >= 0) {
+    sizes.push(size);
+  }
+
+  bool analyse = suspicious || prefilter_run + 1 >= PERIOD;
+  if (suspicious) {
+    prefilter_guard = 2 + (prefilter > 1 ? pCodecCtx->has_b_frames : 0);
+  } else if (prefilter_guard > 0) {
+    prefilter_guard--;
+    analyse = true;
+  }
+  prefilter_run = analyse ? 0 : prefilter_run + 1;
+  if (prefilter > 1 && frame->pts != AV_NOPTS_VALUE) {
+    pCodecCtx->skip_frame = analyse ? AVDISCARD_DEFAULT : AVDISCARD_NONREF;
+  }
+
+  prefilter_frames++;
+  if (!analyse) prefilter_skipped++;
+  return analyse;
+}
+
+/*
+ * The previous frame was skipped by the pre-filter: convert it now from
+ * the decoder's reference, as the current one is compared with it
+ */
+void film::catch_up_previous() {
+  AVFrame *prev = keep_prev_rgb ? pFrameRGBprev : pFrameRGB;
+  conversions->next_frame();
+  if (analyse_rgb &&
+      conversions->get(pFramePrevDecoded, AV_PIX_FMT_RGB24, width, height,
+                       SWS_BICUBIC, prev) == NULL) {
+    fprintf(stderr, "Cannot initialize the converted RGB image context!\n");
+    exit(1);
+  }
+  detection.prime(prev);
+  // The last score is from before the skipped frames: compare as on the
+  // first frame
+  prev_score = 0;
+  prev_bound = 0;
+  previous_stale = false;
+}
+
+/*
+ * The pre-filter skipped a frame: the graphs repeat the values of the last
+ * analysed one, so they still have a column per frame
+ */
+void film::repeat_graph_values() {
+  g->push_data(graph_score);
+  if (draw_rgb_graph || draw_hsv_graph) {
+    g->push_rgb(graph_rgb[0], graph_rgb[1], graph_rgb[2]);
+    g->push_rgb_to_hsv(graph_rgb[0], graph_rgb[1], graph_rgb[2]);
+  }
+  if (draw_yuv_graph) {
+    g->push_yuv(graph_yuv);
   }
 }
 
@@ -255,18 +704,250 @@ static unsigned int maxThreadCount() {
     }
 }
 
+/*
+ * Whether reaching "target" from the last decoded frame at "position" needs
+ * a seek: it does unless the keyframe before the target has already been
+ * passed, or without an index, unless the target is less than "gap" ahead.
+ */
+static bool need_seek(AVStream *stream, int64_t position, int64_t target,
+                      int64_t gap) {
+  if (position == AV_NOPTS_VALUE || target <= position) return true;
+  int k = av_index_search_timestamp(stream, target, AVSEEK_FLAG_BACKWARD);
+  if (k >= 0) return stream->index_entries[k].timestamp > position;
+  return target - position > gap;
+}
+
+/*
+ * Decode the frames of extractions [begin, end) with a demuxer and decoder
+ * of their own. The sorted targets are reached by seeking to the keyframe
+ * before each one, or by decoding on when that is closer. Without
+ * timestamps the stream is decoded once from the start, counting frames.
+ * A target that cannot be reached is skipped. The decoder uses "threads"
+ * threads; images are written under "lock".
+ */
+void film::extract_range(size_t begin, size_t end, bool by_pts, int threads,
+                         mutex &lock) {
+  AVFormatContext *fmt_ctx = NULL;
+  if (avformat_open_input(&fmt_ctx, input_path.c_str(), NULL, NULL) != 0 ||
+      avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+    shotlog("Cannot reopen " + input_path + " to extract the images");
+    if (fmt_ctx != NULL) avformat_close_input(&fmt_ctx);
+    return;
+  }
+  AVStream *stream = fmt_ctx->streams[videoStream];
+  AVCodecContext *ctx = stream->codec;
+  ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  ctx->thread_count = threads;
+  if (jpeg_out != NULL) ctx->refcounted_frames = 1;
+  if (avcodec_open2(ctx, pCodec, NULL) < 0) {
+    shotlog("Cannot open the decoder to extract the images");
+    avformat_close_input(&fmt_ctx);
+    return;
+  }
+
+  AVFrame *frame = av_frame_alloc();
+  AVFrame *rgb = NULL;
+  convert::cache local;  // this decoder's own conversions
+
+  const int64_t gap = int64_t(2 / av_q2d(stream->time_base));
+  AVPacket pkt;
+  int index = 0;                      // frames decoded from the start
+  int64_t position = AV_NOPTS_VALUE;  // timestamp of the last one
+  bool eof = false;
+
+  /* Decode the next frame, draining the decoder at the end of the stream */
+  auto next_frame = [&]() -> bool {
+    for (;;) {
+      int finished = 0;
+      if (!eof && av_read_frame(fmt_ctx, &pkt) < 0) {
+        eof = true;
+      }
+      if (eof) {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        avcodec_decode_video2(ctx, frame, &finished, &pkt);
+        if (!finished) return false;
+      } else {
+        if (pkt.stream_index == videoStream) {
+          avcodec_decode_video2(ctx, frame, &finished, &pkt);
+        }
+        av_free_packet(&pkt);
+      }
+      if (finished) {
+        index++;
+        position = av_frame_get_best_effort_timestamp(frame);
+        return true;
+      }
+    }
+  };
+
+  size_t i = begin;
+  while (i < end) {
+    const extraction &e = extractions[i];
+    if (by_pts && need_seek(stream, position, e.pts, gap)) {
+      av_seek_frame(fmt_ctx, videoStream, e.pts, AVSEEK_FLAG_BACKWARD);
+      avcodec_flush_buffers(ctx);
+      eof = false;
+      position = AV_NOPTS_VALUE;
+    }
+    bool found = false;
+    while (!found && next_frame()) {
+      found = by_pts ? position >= e.pts : index >= e.index;
+    }
+    if (!found) {
+      shotlog(fmt::format("Cannot extract the image of frame {}",
+                          e.frame_number));
+      // Seek again for the next target rather than decode on from here
+      position = AV_NOPTS_VALUE;
+      i++;
+      continue;
+    }
+
+    if (jpeg_out == NULL) {
+      local.next_frame();
+      rgb = local.get(frame, AV_PIX_FMT_RGB24, width, height, SWS_BICUBIC);
+      if (rgb == NULL) {
+        shotlog("Cannot initialize the converted RGB image context");
+        break;
+      }
+    }
+    lock_guard<mutex> guard(lock);
+    conversions->next_frame();
+    /* Every image taken from this frame */
+    for (; i < end && (by_pts ? extractions[i].pts <= position
+                              : extractions[i].index <= index);
+         i++) {
+      write_image(extractions[i].im, rgb, frame, extractions[i].frame_number);
+      extractions[i].written = true;
+    }
+  }
+
+  av_frame_free(&frame);
+  avcodec_close(ctx);
+  avformat_close_input(&fmt_ctx);
+}
+
+/*
+ * Deferred mode: decode only the frames the images are taken from, in
+ * frame order, split into contiguous ranges over a few decoders when the
+ * stream has timestamps to seek on
+ */
+void film::extract_images() {
+  if (extractions.empty()) return;
+  stable_sort(extractions.begin(), extractions.end(),
+              [](const extraction &a, const extraction &b) {
+                return a.index < b.index;
+              });
+  bool by_pts = true;
+  for (size_t i = 0; i < extractions.size(); i++) {
+    if (extractions[i].pts == AV_NOPTS_VALUE) by_pts = false;
+  }
+
+  const size_t n = extractions.size();
+  size_t workers = by_pts ? min<size_t>(min(4U, maxThreadCount()), (n + 7) / 8)
+                          : 1;
+  // The decoders share the threads between them
+  const int threads = max<int>(1, maxThreadCount() / workers);
+  mutex lock;
+  if (workers <= 1) {
+    extract_range(0, n, by_pts, threads, lock);
+  } else {
+    vector<future<void>> tasks;
+    for (size_t w = 0; w < workers; w++) {
+      tasks.push_back(async(launch::async, &film::extract_range, this,
+                            n * w / workers, n * (w + 1) / workers, by_pts,
+                            threads, ref(lock)));
+    }
+    for (size_t w = 0; w < tasks.size(); w++) {
+      tasks[w].get();
+    }
+  }
+
+  /* Images that could not be extracted are left out of the results */
+  vector<image *> missing;
+  for (size_t i = 0; i < n; i++) {
+    if (!extractions[i].written) missing.push_back(extractions[i].im);
+  }
+  if (!missing.empty()) {
+    shotlog(fmt::format("{} of {} images could not be extracted",
+                        missing.size(), n));
+    sort(missing.begin(), missing.end());
+    for (list<shot>::iterator il = shots.begin(); il != shots.end(); il++) {
+      if (binary_search(missing.begin(), missing.end(), il->img_begin)) {
+        il->img_begin = NULL;
+      }
+      if (binary_search(missing.begin(), missing.end(), il->img_end)) {
+        il->img_end = NULL;
+      }
+    }
+    for (size_t i = 0; i < missing.size(); i++) {
+      delete missing[i];
+    }
+  }
+  extractions.clear();
+
+  // The images now have their names
+  shots_memory = 0;
+  for (list<shot>::iterator il = shots.begin(); il != shots.end(); il++) {
+    shots_memory += shot_memory(*il);
+  }
+  if (!shots.empty()) shots_memory -= shot_memory(shots.back());
+}
+
 int film::process() {
   int audioSize;
   int frameFinished;
   shot s;
-  static struct SwsContext *img_convert_ctx = NULL;
-  static struct SwsContext *img_ctx = NULL;
   int frame_number;
 
   create_main_dir();
 
+  /*
+   * The flash filter confirms cuts a few frames late, when their frames
+   * are gone: their images are extracted after detection
+   */
+  if (flash_lookahead > 0) {
+    deferred_images = true;
+  }
+  if (max_memory && deferred_images) {
+    shotlog("Deferred images: the shots stay in memory until their images "
+            "are extracted");
+  }
+
   string graphpath = this->global_path + "/" + this->alphaid;
-  g = new graph(600, 400, graphpath, threshold, this);
+
+  /*
+   * Lean mode: no graph is kept at all, the cut decision only needs the
+   * previous and the current score.
+   */
+  if (lean) {
+    draw_rgb_graph = false;
+    draw_hsv_graph = false;
+    draw_yuv_graph = false;
+    if (video_set) {
+      shotlog("Lean mode: the video XML is not written");
+    }
+  } else {
+    g = new graph(600, 400, graphpath, threshold, this);
+    g->set_target_width(graph_width);
+
+    /*
+     * Bounded memory: spill per-frame series to disk and draw the graphs
+     * from a decimated copy whose size depends only on the budget.
+     */
+    if (max_memory) {
+      const size_t column_bytes = SERIES_COUNT * sizeof(series::bucket);
+      const size_t columns = graph_width ? graph_width :
+          min<size_t>(8192, max<size_t>(600, max_memory / 4 / column_bytes));
+      if (!g->set_bounded(columns)) {
+        shotlog("Cannot create spill files, memory will not be bounded");
+      }
+    }
+    if (graph_chunks) {
+      g->start_chunks();
+    }
+  }
 
   /*
    * Register all formats and codecs
@@ -326,16 +1007,86 @@ int film::process() {
   }
   update_metadata();
 
+  if (pack_images && (thumb_set || shot_set)) {
+    open_pack();
+  }
+  if (thumb_set && sheet_columns > 0 && videoStream != -1 && height > 0) {
+    open_sheets();
+  }
+
+  /*
+   * Reserve the per-frame graph series for the whole film up front
+   */
+  if (g && videoStream != -1 && pFormatCtx->duration > 0 && fps > 0) {
+    g->reserve_frames(
+        size_t(double(pFormatCtx->duration) / AV_TIME_BASE * fps) + 1);
+  }
+
   /*
    * Find the decoder for the video stream
    */
   if (videoStream != -1) {
     pCodecCtx = pFormatCtx->streams[videoStream]->codec;
-    pCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    /*
+     * Frame threads would hold back many frames decoded under an older
+     * skip_frame setting: the level 2 pre-filter keeps slice threads only
+     */
+    pCodecCtx->thread_type =
+        prefilter > 1 ? FF_THREAD_SLICE : FF_THREAD_FRAME | FF_THREAD_SLICE;
     pCodecCtx->thread_count = maxThreadCount();
     pCodec = avcodec_find_decoder(pCodecCtx->codec_id);
 
     if (pCodec == NULL) return -1;  // Codec not found
+    conversions = new convert::cache();
+
+    /*
+     * Detectors: the legacy options stand for "sad" or "histogram", with
+     * "tile" and "mv" fused behind
+     */
+    if (detectors.empty()) {
+      detectors = hist_threshold > 0 ? "histogram" : "sad";
+      if (tile_ratio > 0) detectors += ",tile";
+      if (mv_threshold > 0) detectors += ",mv";
+    }
+    /* The planar detector reads 8, 10 and 12-bit planar YUV only */
+    if (!processing::planar_supported(pCodecCtx->pix_fmt)) {
+      istringstream names(detectors);
+      string name, replaced;
+      while (getline(names, name, ',')) {
+        if (name == "planar") {
+          shotlog("Detectors: planar YUV needed, sad used instead");
+          name = "sad";
+        }
+        replaced += (replaced.empty() ? "" : ",") + name;
+      }
+      detectors = replaced;
+    }
+    const detector::settings settings = {threshold, hist_threshold,
+                                         tile_ratio, mv_threshold};
+    string error;
+    if (!detection.setup(detectors, settings, error)) {
+      shotlog("Detectors: " + error);
+      return -1;
+    }
+
+    /*
+     * Direct JPEG output encodes the decoded frames themselves, the
+     * pre-filter converts the previous frame only when the next one needs
+     * analysis and the planar detector reads it as decoded, so keep a
+     * reference to it instead of copying it
+     */
+    if (direct_jpeg || prefilter > 0 ||
+        (detection.features() & kernels::PLANES)) {
+      pCodecCtx->refcounted_frames = 1;
+      pFramePrevDecoded = av_frame_alloc();
+    }
+    if (direct_jpeg) {
+      jpeg_out = new jpeg::writer(2, conversions);
+    }
+    /* Motion vectors come with the decoded frames as side data */
+    if (detection.uses_motion()) {
+      pCodecCtx->flags2 |= AV_CODEC_FLAG2_EXPORT_MVS;
+    }
     if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0)
       return -1;  // Could not open codec
 
@@ -359,14 +1110,66 @@ int film::process() {
     //
     pFrameRGB->width = width;
     pFrameRGB->height = height;
-    av_image_alloc(pFrameRGBprev->data, pFrameRGBprev->linesize, width, height, AV_PIX_FMT_RGB24, alignment);
-    pFrameRGBprev->width = width;
-    pFrameRGBprev->height = height;
+    /*
+     * Detectors that only keep features of the previous frame (histogram,
+     * motion vectors) do not need its pixels; they are then only needed
+     * for end images drawn with gd
+     */
+    keep_prev_rgb = (detection.features() & (kernels::SAD | kernels::TILES)) ||
+                    display ||
+                    (last_img_set && jpeg_out == NULL && !deferred_images);
+    /*
+     * Without graphs, RGB features or images drawn with gd, the frames
+     * are not converted to RGB at all
+     */
+    analyse_rgb = (detection.features() & kernels::ALL) || g != NULL ||
+                  display ||
+                  ((first_img_set || last_img_set) && jpeg_out == NULL &&
+                   !deferred_images);
+    if (keep_prev_rgb) {
+      av_image_alloc(pFrameRGBprev->data, pFrameRGBprev->linesize, width, height, AV_PIX_FMT_RGB24, alignment);
+      pFrameRGBprev->width = width;
+      pFrameRGBprev->height = height;
+    }
+    /*
+     * Sampled SAD: only for the plain sad detector in lean mode, whose
+     * scores nothing else reads below the threshold. It keeps one more RGB
+     * frame to score an estimated frame again when a cut depends on it.
+     */
+    sampling = sampled_sad && detection.size() == 1 &&
+               detection.features() == kernels::SAD && g == NULL &&
+               adaptive_k == 0 && gradual_threshold == 0 && prefilter == 0;
+    if (sampled_sad && !sampling) {
+      shotlog("Sampled SAD: needs --lean and the sad detector alone, "
+              "without --adaptive, --gradual or --prefilter; every frame is "
+              "read");
+    }
+    if (sampling) {
+      pFrameRGBprev2 = av_frame_alloc();
+      av_image_alloc(pFrameRGBprev2->data, pFrameRGBprev2->linesize, width, height, AV_PIX_FMT_RGB24, alignment);
+      pFrameRGBprev2->width = width;
+      pFrameRGBprev2->height = height;
+    }
     // YUV:
     av_image_alloc(pFrameYUV->data, pFrameYUV->linesize, width, height, AV_PIX_FMT_YUV444P, alignment);
     pFrameYUV->width = width;
     pFrameYUV->height = height;
 
+    if (adaptive_k > 0) {
+      score_stats = decision::rolling_stats(max(8, adaptive_window));
+    }
+    if (flash_lookahead > 0) {
+      flashes = decision::flash_filter(flash_lookahead);
+    }
+
+    /*
+     * Twin comparison: the hard cut threshold is the high one
+     */
+    if (gradual_threshold > 0) {
+      gradual = decision::twin_comparison(gradual_threshold,
+                                          detection.threshold());
+    }
+
     /*
      * Mise en place du premier plan
      */
@@ -403,6 +1206,20 @@ int film::process() {
 
       if (frameFinished) {
         frame_number = pCodecCtx->frame_number;  // Current frame number
+        cur_index = frame_number;
+        cur_pts = av_frame_get_best_effort_timestamp(pFrame);
+
+        /*
+         * Frames dropped by the decoder are not counted: number frames
+         * from their timestamps instead
+         */
+        if (prefilter > 1 && cur_pts != AV_NOPTS_VALUE) {
+          if (first_pts == AV_NOPTS_VALUE) first_pts = cur_pts;
+          const AVRational tb = pFormatCtx->streams[videoStream]->time_base;
+          frame_number =
+              int(llround((cur_pts - first_pts) * av_q2d(tb) * fps)) + 1;
+          cur_index = frame_number;
+        }
 
         // Report progress information every N frames
         if (frame_number % progress_frame_interval == 0) {
@@ -422,81 +1239,99 @@ int film::process() {
           const double percent = current_secs / duration_secs * 100;
           this->shotlog(fmt::format("Progress: frame={:6}, time={:.1f}s, duration={:.1f}s, percent={:.3f}%%, fps={:.1f}",
                                                frame_number, current_secs, duration_secs, percent, computation_fps));
-        }
 
-        // Convert the image into YUV444
-        if (!img_ctx) {
-            #warning Potential to subsample image
-            int flags = SWS_BICUBIC;
-          img_ctx =
-              sws_getContext(width, height, pCodecCtx->pix_fmt, width, height,
-                             AV_PIX_FMT_YUV444P, flags, NULL, NULL, NULL);
-          if (!img_ctx) {
-            fprintf(stderr,
-                    "Cannot initialize the converted YUV image context!\n");
-            exit(1);
+          if (max_memory && !memory_warned) {
+            memory_usage usage = get_memory_usage();
+            if (usage.graph + usage.shots + usage.frames > max_memory) {
+              this->shotlog("Memory budget exceeded");
+              log_memory_usage();
+              memory_warned = true;
+            }
           }
         }
 
-        // Convert the image into RGB24
-        if (!img_convert_ctx) {
-            #warning Potential to subsample image
-            int flags = SWS_BICUBIC;
-          img_convert_ctx =
-              sws_getContext(width, height, pCodecCtx->pix_fmt, width, height,
-                             AV_PIX_FMT_RGB24, flags, NULL, NULL, NULL);
-          if (!img_convert_ctx) {
+        /*
+         * Shot interiors told by the compressed-domain signals are not
+         * analysed at all
+         */
+        const bool analyse = frame_number == 1 || prefilter == 0 ||
+                             prefilter_frame(pFrame);
+        if (analyse && previous_stale) {
+          catch_up_previous();
+        }
+        previous_stale = !analyse;
+        if (g != NULL && prefilter > 0 && frame_number > 1) {
+          // Frames the decoder dropped at level 2, then this one if skipped
+          for (int i = prev_index + 1; i < cur_index; i++) {
+            repeat_graph_values();
+          }
+          if (!analyse) repeat_graph_values();
+        }
+        if (analyse) {
+          /*
+           * Convert the decoded picture for the analysis: RGB24 for the frame
+           * difference, YUV444 for the YUV graph. Contexts and outputs are
+           * shared through the conversion cache with the image writers.
+           */
+          conversions->next_frame();
+          if (analyse_rgb &&
+              conversions->get(pFrame, AV_PIX_FMT_RGB24, width, height,
+                               SWS_BICUBIC, pFrameRGB) == NULL) {
             fprintf(stderr,
                     "Cannot initialize the converted RGB image context!\n");
             exit(1);
           }
-        }
 
-        /*
-         * Calling "sws_scale" is used to copy the data from "pFrame->data" to
-         *other
-         * frame buffers for later processing. It is also used to convert
-         *between
-         * different pix_fmts.
-         *
-         * API: int sws_scale(SwsContext *c, uint8_t *src, int srcStride[], int
-         *srcSliceY, int srcSliceH, uint8_t dst[], int dstStride[] )
-        */
-        sws_scale(img_convert_ctx, pFrame->data, pFrame->linesize, 0,
-                  pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
-
-        sws_scale(img_ctx, pFrame->data, pFrame->linesize, 0, pCodecCtx->height,
-                  pFrameYUV->data, pFrameYUV->linesize);
-
-        /* Extract pixel color information  */
-        get_yuv_colors(*pFrameYUV);
-
-        /* If it's not the first image */
-        if (frame_number != 1) {
-          CompareFrame(pFrameRGB, pFrameRGBprev);
-        } else {
-          /*
-           * Cas ou c'est la premiere image, on cree la premiere image dans tous
-           * les cas
-           */
-          image *begin_i = new image(this, width, height, s.myid, BEGIN,
-                                     this->thumb_set, this->shot_set);
-          begin_i->create_img_dir();
+          if (this->draw_yuv_graph) {
+            if (conversions->get(pFrame, AV_PIX_FMT_YUV444P, width, height,
+                                 SWS_BICUBIC, pFrameYUV) == NULL) {
+              fprintf(stderr,
+                      "Cannot initialize the converted YUV image context!\n");
+              exit(1);
+            }
+
+            /* Extract pixel color information  */
+            get_yuv_colors(*pFrameYUV);
+          }
+
+          if (detection.uses_motion()) {
+            motion = processing::motion_vector_stats(pFrame);
+          }
+
+          /* If it's not the first image */
+          if (frame_number != 1) {
+            CompareFrame(pFrameRGB, pFrameRGBprev);
+          } else {
+            /*
+             * Cas ou c'est la premiere image, on cree la premiere image dans tous
+             * les cas
+             */
+            detection.prime(pFrameRGB);
+            image *begin_i = new image(this, width, height, s.myid, BEGIN,
+                                       this->thumb_set, this->shot_set);
+            begin_i->create_img_dir();
 
 #ifdef WXWIDGETS
-          if (this->first_img_set ||
-              (display && dialogParent->checkbox_1->GetValue()))
+            if (this->first_img_set ||
+                (display && dialogParent->checkbox_1->GetValue()))
 #else
-          if (this->first_img_set)
+            if (this->first_img_set)
 #endif
-          {
-            begin_i->SaveFrame(pFrameRGB, frame_number);
-            shots.back().img_begin = begin_i;
+            {
+              save_image(begin_i, pFrameRGB, pFrame, frame_number);
+              shots.back().img_begin = begin_i;
+            }
           }
+          /* Current frame becomes "previous" for next round */
+          if (sampling) swap(pFrameRGBprev, pFrameRGBprev2);
+          if (keep_prev_rgb) swap(pFrameRGB, pFrameRGBprev);
+        }
+        prev_index = cur_index;
+        prev_pts = cur_pts;
+        if (pFramePrevDecoded != NULL) {
+          av_frame_unref(pFramePrevDecoded);
+          av_frame_move_ref(pFramePrevDecoded, pFrame);
         }
-        /* Copy current frame as "previous" for next round */
-        av_picture_copy((AVPicture *)pFrameRGBprev, (AVPicture *)pFrameRGB,
-                        AV_PIX_FMT_RGB24, width, height);
 
         if (display) do_stats(pCodecCtx->frame_number);
       }
@@ -511,8 +1346,42 @@ int film::process() {
   }
 
   if (videoStream != -1) {
+    /* A cut still held back by the flash filter */
+    if (flash_lookahead > 0) {
+      if (flashes.finish()) {
+        add_cut(held_cut, NULL, NULL);
+      }
+      shotlog(fmt::format("Flash filter: {} flashes suppressed",
+                          flashes.suppressed()));
+    }
+
+    if (detection.size() > 1) {
+      shotlog(fmt::format("Detectors {}: {} cuts ruled out", detectors,
+                          vetoed_cuts));
+    }
+
+    if (sampling) {
+      shotlog(fmt::format(
+          "Sampled SAD: {} of {} frames read entirely ({:.1f}%)",
+          sampled_exact, sampled_frames,
+          sampled_frames ? 100.0 * sampled_exact / sampled_frames : 0));
+    }
+
+    if (prefilter > 0) {
+      shotlog(fmt::format(
+          "Pre-filter: pixel analysis skipped for {} of {} frames ({:.1f}%)",
+          prefilter_skipped, prefilter_frames,
+          prefilter_frames ? 100.0 * prefilter_skipped / prefilter_frames : 0));
+      /* The last frame may not have been converted */
+      if (previous_stale) {
+        catch_up_previous();
+      }
+    }
+
     /* Mise en place de la dernière image */
-    shots.back().fduration = pFrame->coded_picture_number - shots.back().fbegin;
+    AVFrame *pFrameLast = pFramePrevDecoded != NULL ? pFramePrevDecoded : pFrame;
+    // Index of the last frame, numbered like the cut frames
+    shots.back().fduration = cur_index - shots.back().fbegin;
     shots.back().msduration = int(((shots.back().fduration) * 1000) / fps);
     duration.mstotal = int(shots.back().msduration + shots.back().msbegin);
 #ifdef WXWIDGETS
@@ -523,23 +1392,40 @@ int film::process() {
     {
       image *end_i = new image(this, width, height, shots.back().myid, END,
                                this->thumb_set, this->shot_set);
-      end_i->SaveFrame(pFrameRGB, frame_number);
+      save_image(end_i, keep_prev_rgb ? pFrameRGBprev : pFrameRGB, pFrameLast,
+                 frame_number);
       shots.back().img_end = end_i;
     }
+    if (gradual_threshold > 0 && gradual.finish()) {
+      transitions.push_back(gradual.last());
+    }
+    extract_images();
+    close_sheets();
+    close_pack();
 
     /*
      * Graph 'quantity of movement'
+     * The graph images are drawn and encoded on their own tasks while the
+     * remaining output is written. In chunked mode they were drawn during
+     * processing, only the last chunks and the index remain.
      */
-    g->init_gd();
-    g->draw_all_canvas();
-    g->draw_color_datas();
-    g->draw_datas();
-    if (video_set) {
-      string xml_color = graphpath + "/" + alphaid + "_video.xml";
-      g->write_xml(xml_color);
-      // TODO Add progressive json output
+    if (g) {
+      if (graph_chunks) {
+        g->finish_chunks();
+      } else {
+        g->render_async();
+      }
+      if (video_set) {
+        string xml_color = graphpath + "/" + alphaid + "_video.xml";
+        g->write_xml(xml_color);
+        // TODO Add progressive json output
+      }
+      if (graph_tiles) {
+        g->write_tiles();
+      }
+      g->wait_render();
     }
-    g->save();
+    if (get_progress() || max_memory) log_memory_usage();
 
     /*
      * Free the RGB images
@@ -547,7 +1433,15 @@ int film::process() {
     av_free(pFrame);
     av_free(pFrameRGB);
     av_free(pFrameRGBprev);
+    av_free(pFrameRGBprev2);
     av_free(pFrameYUV);
+    av_frame_free(&pFramePrevDecoded);
+    if (jpeg_out != NULL) {
+      delete jpeg_out;
+      jpeg_out = NULL;
+    }
+    delete conversions;
+    conversions = NULL;
     avcodec_close(pCodecCtx);
   }
 
@@ -667,6 +1561,24 @@ film::film(DialogShotDetect *d) {
 
   display = 1;
   threshold = DEFAULT_THRESHOLD;
+  tile_ratio = 0;
+  hist_threshold = 0;
+  mv_threshold = 0;
+  vetoed_cuts = 0;
+  gradual_threshold = 0;
+  adaptive_k = 0;
+  adaptive_window = 64;
+  flash_lookahead = 0;
+  prefilter = 0;
+  prefilter_guard = prefilter_run = 0;
+  prefilter_frames = prefilter_skipped = 0;
+  previous_stale = false;
+  graph_score = 0;
+  graph_rgb[0] = graph_rgb[1] = graph_rgb[2] = 0;
+  graph_yuv.y = graph_yuv.u = graph_yuv.v = 0;
+  first_pts = AV_NOPTS_VALUE;
+  keep_prev_rgb = true;
+  analyse_rgb = true;
   samplearg = 1000;
   samples = 0;
   minright = MAX_INT;
@@ -676,6 +1588,34 @@ film::film(DialogShotDetect *d) {
   ech = 0;
   nchannel = 1;
   audio_buf = NULL;
+  max_memory = 0;
+  memory_warned = false;
+  shots_memory = 0;
+  spill_failed = false;
+  graph_width = 0;
+  graph_tiles = false;
+  graph_chunks = false;
+  graph_svg = false;
+  lean = false;
+  direct_jpeg = false;
+  thumb_heights.assign(1, THUMB_HEIGHT);
+  sheet_columns = 0;
+  sheet_rows = 0;
+  pack_images = false;
+  image_pack = NULL;
+  deferred_images = false;
+  cur_index = prev_index = 0;
+  cur_pts = prev_pts = AV_NOPTS_VALUE;
+  jpeg_out = NULL;
+  conversions = NULL;
+  pFramePrevDecoded = NULL;
+  pFrameRGBprev2 = NULL;
+  sampled_sad = false;
+  sampling = false;
+  prev_bound = 0;
+  sampled_frames = sampled_exact = 0;
+  g = NULL;
+  videoStream = -1;
 }
 #endif
 
@@ -683,6 +1623,24 @@ film::film() {
   // Initialization of default values (non GUI)
   display = 0;
   threshold = DEFAULT_THRESHOLD;
+  tile_ratio = 0;
+  hist_threshold = 0;
+  mv_threshold = 0;
+  vetoed_cuts = 0;
+  gradual_threshold = 0;
+  adaptive_k = 0;
+  adaptive_window = 64;
+  flash_lookahead = 0;
+  prefilter = 0;
+  prefilter_guard = prefilter_run = 0;
+  prefilter_frames = prefilter_skipped = 0;
+  previous_stale = false;
+  graph_score = 0;
+  graph_rgb[0] = graph_rgb[1] = graph_rgb[2] = 0;
+  graph_yuv.y = graph_yuv.u = graph_yuv.v = 0;
+  first_pts = AV_NOPTS_VALUE;
+  keep_prev_rgb = true;
+  analyse_rgb = true;
   samplearg = 1000;
   samples = 0;
   minright = MAX_INT;
@@ -692,6 +1650,34 @@ film::film() {
   ech = 0;
   nchannel = 1;
   audio_buf = NULL;
+  max_memory = 0;
+  memory_warned = false;
+  shots_memory = 0;
+  spill_failed = false;
+  graph_width = 0;
+  graph_tiles = false;
+  graph_chunks = false;
+  graph_svg = false;
+  lean = false;
+  direct_jpeg = false;
+  thumb_heights.assign(1, THUMB_HEIGHT);
+  sheet_columns = 0;
+  sheet_rows = 0;
+  pack_images = false;
+  image_pack = NULL;
+  deferred_images = false;
+  cur_index = prev_index = 0;
+  cur_pts = prev_pts = AV_NOPTS_VALUE;
+  jpeg_out = NULL;
+  conversions = NULL;
+  pFramePrevDecoded = NULL;
+  pFrameRGBprev2 = NULL;
+  sampled_sad = false;
+  sampling = false;
+  prev_bound = 0;
+  sampled_frames = sampled_exact = 0;
+  g = NULL;
+  videoStream = -1;
 
   this->first_img_set = false;
   this->last_img_set = false;
@@ -14,7 +14,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <functional>
 #include <list>
+#include <mutex>
+#include <vector>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -28,7 +31,10 @@ extern "C" {
 #include <wx/wx.h>
 #endif
 
+#include <decision.h>
+#include <detector.h>
 #include <image.h>
+#include <processing.h>
 #include <shot.h>
 #include <xml.h>
 #include <graph.h>
@@ -58,6 +64,18 @@ class shot;
 class xml;
 class DialogShotDetect;
 class graph;
+namespace jpeg {
+class writer;
+}
+namespace sprite {
+class sheet;
+}
+namespace pack {
+class writer;
+}
+namespace convert {
+class cache;
+}
 class film {
  private:
   /* Variables d'état */
@@ -85,6 +103,72 @@ class film {
   AVFrame *pFrameRGBprev;
   // - YUV:
   AVFrame *pFrameYUV;
+  // Previous decoded frame (direct JPEG output only):
+  AVFrame *pFramePrevDecoded;
+  jpeg::writer *jpeg_out;
+  // Conversions of the decoded frames, shared by every stage:
+  convert::cache *conversions;
+  // Detectors fused over one scan of each frame:
+  detector::chain detection;
+  // Whether pFrameRGBprev is kept, the histogram detector may not need it:
+  bool keep_prev_rgb;
+  // Whether the decoded frames are converted to RGB for the analysis:
+  bool analyse_rgb;
+  // Sampled SAD: whether it applies, the frame before pFrameRGBprev, the
+  // error bound of the previous score (0 when exact) and the share of
+  // frames read entirely
+  bool sampling;
+  AVFrame *pFrameRGBprev2;
+  double prev_bound;
+  size_t sampled_frames, sampled_exact;
+  // Gradual transition detector:
+  decision::twin_comparison gradual;
+  // Recent scores of the adaptive threshold:
+  decision::rolling_stats score_stats;
+  // A detected cut: first frame of the new shot and the frame before it
+  struct cut_point {
+    int frame_number;
+    int index, prev_index;
+    int64_t pts, prev_pts;
+  };
+  // Flash filter: the cut it holds back and the histogram before it
+  decision::flash_filter flashes;
+  cut_point held_cut;
+  processing::Histogram held_hist;
+  // Pre-filter: recent packet sizes of P (and I) and of B pictures, frames
+  // still analysed after a suspicious one, frames skipped in a row and the
+  // skip ratio
+  decision::rolling_stats packet_sizes[2];
+  int prefilter_guard, prefilter_run;
+  size_t prefilter_frames, prefilter_skipped;
+  // The previous frame was skipped, its RGB conversion is missing:
+  bool previous_stale;
+  // Graph values of the last analysed frame, repeated for skipped ones:
+  double graph_score;
+  double graph_rgb[3];
+  processing::YUVTriple graph_yuv;
+  // Timestamp of the first frame, to number frames when some are dropped:
+  int64_t first_pts;
+  // Motion vectors exported for the current frame, and the cuts of the
+  // first detector that the others did not confirm
+  processing::MotionStats motion;
+  size_t vetoed_cuts;
+
+  /*
+   * Deferred extraction: an image to take from decoded frame "index"
+   * (counted from 1) with timestamp "pts", named after "frame_number"
+   */
+  struct extraction {
+    image *im;
+    int index;
+    int64_t pts;
+    int frame_number;
+    bool written;
+  };
+  vector<extraction> extractions;
+  // Decoded frame count and timestamp of the current and previous frame:
+  int cur_index, prev_index;
+  int64_t cur_pts, prev_pts;
 
   AVPacket packet;
 
@@ -112,12 +196,42 @@ class film {
   void do_stats(int frame);
   void get_yuv_colors(AVFrame &pFrame);
   void CompareFrame(AVFrame *pFrame, AVFrame *pFramePrev);
+  void save_image(image *im, AVFrame *rgb, AVFrame *decoded, int frame_number);
+  void defer_image(image *im, int index, int64_t pts, int frame_number);
+  void add_cut(const cut_point &c, AVFrame *rgb, AVFrame *rgb_prev);
+  bool prefilter_frame(AVFrame *frame);
+  void catch_up_previous();
+  void repeat_graph_values();
+  void write_image(image *im, AVFrame *rgb, AVFrame *decoded, int frame_number);
+  void extract_images();
+  void extract_range(size_t begin, size_t end, bool by_pts, int threads,
+                     mutex &lock);
+  void open_sheets();
+  void close_sheets();
+  void open_pack();
+  void close_pack();
   graph *g;
 
   void update_metadata();
   void init_xml(string filename);
   int close_xml();
 
+  /* Width of decimated graphs in columns, 0 = one column per frame */
+  size_t graph_width;
+
+  /* Memory budget in bytes, 0 = unbounded */
+  size_t max_memory;
+  bool memory_warned;
+  /*
+   * Bytes held by the shots in memory but the last one, which may still
+   * change, and the finished shots moved to disk once over the budget
+   */
+  size_t shots_memory;
+  shot_store spilled_shots;
+  bool spill_failed;
+  static size_t shot_memory(const shot &s);
+  void bound_shots();
+
  public:
   bool thumb_set;
   bool shot_set;
@@ -176,6 +290,27 @@ class film {
   string code_lang;
   /* Processing threshold */
   int threshold;
+  /* Share of 8x8 tiles over the threshold a cut needs, 0 = global score only */
+  double tile_ratio;
+  /* Colour histogram threshold in percent, 0 = pixel difference detector */
+  int hist_threshold;
+  /* Motion vector score a cut needs in predicted pictures, 0 = unused */
+  int mv_threshold;
+  /* Detectors "first,fused,...", empty = from the options above */
+  string detectors;
+  /* Adaptive threshold: mean + k stddev of the last frames, 0 = fixed */
+  double adaptive_k;
+  int adaptive_window;
+  /* Compressed-domain pre-filter: 1 skips pixel analysis, 2 also decoding */
+  int prefilter;
+  /* Frames a cut is held back to recognize flashes, 0 = no flash filter */
+  int flash_lookahead;
+  /* Estimate the SAD from sampled rows, read frames entirely near a cut */
+  bool sampled_sad;
+  /* Low threshold of the gradual transition detector, 0 = hard cuts only */
+  int gradual_threshold;
+  /* Detected gradual transitions */
+  vector<decision::transition> transitions;
   /* Embed timecode */
   bool show_timecode;
   /* Alphanumeric ID */
@@ -192,10 +327,48 @@ class film {
   bool draw_rgb_graph;
   bool draw_hsv_graph;
   bool draw_yuv_graph;
+  /* Write graphs as a zoomable tile pyramid */
+  bool graph_tiles;
+  /* Draw graphs in chunks while processing instead of at the end */
+  bool graph_chunks;
+  /* Write the graphs as SVG instead of PNG */
+  bool graph_svg;
+  /* No graph and no per-frame bookkeeping, only shot detection */
+  bool lean;
+  /* Encode shot images from the decoded YUV frames with MJPEG */
+  bool direct_jpeg;
+  /* Heights of the thumbnail renditions, the first one is the main thumb */
+  vector<int> thumb_heights;
+  /* Sprite sheet grid for the thumbnails, 0 = one file per thumbnail */
+  int sheet_columns;
+  int sheet_rows;
+  /* One sheet series per thumbnail height while processing */
+  vector<sprite::sheet *> thumb_sheets;
+  /* Only record the cut frames while detecting, extract images afterwards */
+  bool deferred_images;
+  /* Write the shot images and thumbnails into a single pack file */
+  bool pack_images;
+  /* The pack while processing, NULL when images are files of their own */
+  pack::writer *image_pack;
 
   xml *x;
   bool display;
 
+  /* Bytes held per subsystem */
+  struct memory_usage {
+    size_t graph;
+    size_t shots;
+    size_t frames;
+    long peak_rss;  // KiB, as reported by the OS
+  };
+  memory_usage get_memory_usage();
+  void log_memory_usage();
+  /*
+   * Every shot in order: those moved to disk in bounded memory mode first,
+   * read back one at a time, then those still in memory
+   */
+  void for_each_shot(const function<void(shot &)> &visit);
+
   int process();
   void process_audio();
   void shotlog(string message);
@@ -219,6 +392,18 @@ class film {
     this->input_path = input_file;
   };
   inline void set_threshold(int threshold) { this->threshold = threshold; };
+  inline void set_tile_ratio(double val) { this->tile_ratio = val; };
+  inline void set_hist_threshold(int val) { this->hist_threshold = val; };
+  inline void set_mv_threshold(int val) { this->mv_threshold = val; };
+  inline void set_detectors(string val) { this->detectors = val; };
+  inline void set_gradual_threshold(int val) { this->gradual_threshold = val; };
+  inline void set_flash_lookahead(int val) { this->flash_lookahead = val; };
+  inline void set_prefilter(int val) { this->prefilter = val; };
+  inline void set_sampled_sad(bool val) { this->sampled_sad = val; };
+  inline void set_adaptive(double k, int window) {
+    this->adaptive_k = k;
+    this->adaptive_window = window;
+  };
   inline void set_show_timecode(bool val) { this->show_timecode = val; };
   inline void set_ipath(string path) { this->input_path = path; };
   inline void set_opath(string path) { this->global_path = path; };
@@ -232,9 +417,28 @@ class film {
     return this->progress;
   };
 
+  inline void set_graph_width(size_t width) { this->graph_width = width; };
+  inline void set_max_memory(size_t megabytes) {
+    this->max_memory = megabytes * 1024 * 1024;
+  };
+
   inline void set_draw_rgb_graph(bool val) { this->draw_rgb_graph = val; };
   inline void set_draw_hsv_graph(bool val) { this->draw_hsv_graph = val; };
   inline void set_draw_yuv_graph(bool val) { this->draw_yuv_graph = val; };
+  inline void set_graph_tiles(bool val) { this->graph_tiles = val; };
+  inline void set_graph_chunks(bool val) { this->graph_chunks = val; };
+  inline void set_graph_svg(bool val) { this->graph_svg = val; };
+  inline void set_lean(bool val) { this->lean = val; };
+  inline void set_direct_jpeg(bool val) { this->direct_jpeg = val; };
+  inline void set_pack_images(bool val) { this->pack_images = val; };
+  inline void set_deferred_images(bool val) { this->deferred_images = val; };
+  inline void set_sheet_grid(int columns, int rows) {
+    this->sheet_columns = columns;
+    this->sheet_rows = rows;
+  };
+  inline void set_thumb_heights(const vector<int> &heights) {
+    this->thumb_heights = heights;
+  };
 
   inline bool get_first_img(void) { return this->first_img_set; };
   inline bool get_last_img(void) { return this->last_img_set; };
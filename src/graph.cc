@@ -15,9 +15,30 @@
  */
 #include <graph.h>
 #include <format.h>
+#include <svg.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 using namespace std;
 
+/* Series drawn by every graph kind, terminated by -1 */
+static const int kind_series[][4] = {{-1},
+                                     {SERIES_MOTION, -1},
+                                     {SERIES_RED, SERIES_GREEN, SERIES_BLUE, -1},
+                                     {SERIES_HUE, SERIES_SATURATION, -1},
+                                     {SERIES_Y, SERIES_U, SERIES_V, -1}};
+
+static void make_dir(const string &path) {
+  struct stat buf;
+  if (stat(path.c_str(), &buf) == -1) {
+#if defined(__WINDOWS__) || defined(__MINGW32__)
+    mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0777);
+#endif
+  }
+}
+
 float graph::MAX(float a, float b, float c) {
   if ((a >= b) && (a >= c)) {
     return a;
@@ -49,164 +70,347 @@ graph::graph(int x, int y, string path, int th, film *farg) {
   this->grid_size = 10;
   this->threshold = th;
   this->global_path = path;
+  this->bounded = false;
+  this->target_width = 0;
+  this->frames_per_column = 1;
+  this->chunked = false;
+  this->chunk_stop = false;
 }
 
-graph::~graph() {}
+graph::~graph() { finish_chunks(); }
+
+/*
+ * Switch to bounded memory mode: per-frame values are spilled to scratch
+ * files next to the graphs and drawing uses at most "columns" columns.
+ * Must be called before the first value is pushed.
+ */
+bool graph::set_bounded(size_t columns) {
+  if (!spill_motion.open(global_path + "/motion.spill", sizeof(uint16_t)) ||
+      !spill_hsv.open(global_path + "/hsv.spill", 2 * sizeof(uint16_t))) {
+    spill_motion.close();
+    spill_hsv.close();
+    return false;
+  }
+  decimated.assign(SERIES_COUNT, series::decimator(columns));
+  bounded = true;
+  return true;
+}
 
-void graph::save() {
-  gdImagePng(im_motion_qty, fdmotion_qty);
-  gdImageDestroy(im_motion_qty);
-  fclose(fdmotion_qty);
+/*
+ * Reserve the per-frame series for the expected number of frames, so they
+ * do not grow by reallocation while the film is processed. Only the
+ * series that will be filled are reserved.
+ */
+void graph::reserve_frames(size_t frames) {
+  if (bounded) return;
+  metrics.reserve(frames, this->f->draw_rgb_graph || this->f->draw_hsv_graph,
+                  this->f->draw_yuv_graph);
+}
 
-  if (this->f->draw_rgb_graph) {
-    gdImagePng(im_colors_rgb, fdgraph_rgb);
-    gdImageDestroy(im_colors_rgb);
-    fclose(fdgraph_rgb);
+void metric_table::reserve(size_t frames, bool colors, bool yuv) {
+  motion.reserve(frames);
+  if (colors) {
+    red.reserve(frames);
+    green.reserve(frames);
+    blue.reserve(frames);
+    hue.reserve(frames);
+    saturation.reserve(frames);
+  }
+  if (yuv) {
+    // One more sample than the others: the first frame has no difference
+    y.reserve(frames + 1);
+    u.reserve(frames + 1);
+    v.reserve(frames + 1);
   }
+}
 
-  if (this->f->draw_hsv_graph) {
-    gdImagePng(im_colors_hsv, fdgraph_hsv);
-    gdImageDestroy(im_colors_hsv);
-    fclose(fdgraph_hsv);
+size_t metric_table::size(int index) const {
+  switch (index) {
+    case SERIES_MOTION: return motion.size();
+    case SERIES_RED: return red.size();
+    case SERIES_GREEN: return green.size();
+    case SERIES_BLUE: return blue.size();
+    case SERIES_HUE: return hue.size();
+    case SERIES_SATURATION: return saturation.size();
+    case SERIES_Y: return y.size();
+    case SERIES_U: return u.size();
+    case SERIES_V: return v.size();
   }
+  return 0;
+}
+
+size_t metric_table::memory_usage() const {
+  return (motion.capacity() + hue.capacity() + saturation.capacity()) *
+             sizeof(uint16_t) +
+         (red.capacity() + green.capacity() + blue.capacity() + y.capacity() +
+          u.capacity() + v.capacity()) *
+             sizeof(uint8_t);
+}
 
-  if (this->f->draw_yuv_graph) {
-    gdImagePng(im_colors_yuv, fdgraph_yuv);
-    gdImageDestroy(im_colors_yuv);
-    fclose(fdgraph_yuv);
+/*
+ * Bytes currently held in memory for the per-frame series
+ */
+size_t graph::memory_usage() const {
+  size_t total = metrics.memory_usage();
+  for (size_t i = 0; i < decimated.size(); i++) {
+    total += decimated[i].memory_usage();
+  }
+  for (size_t i = 0; i < columns.size(); i++) {
+    total += columns[i].capacity() * sizeof(series::bucket);
   }
+  return total;
 }
 
-void graph::init_gd() {
-  graph_color canvas_graph_colors;
-  graph_color motion_qty_graph_colors;
-  graph_color rgb_graph_colors;
-  graph_color hsv_graph_colors;
-  graph_color yuv_graph_colors;
+/*
+ * Allocate the colors of one graph kind (IM_MOTION_QTY, ...) in an image
+ */
+graph::graph_color graph::allocate_colors(gdImagePtr im, int kind) {
+  graph_color colors = graph_color();
+
+  switch (kind) {
+    case IM_MOTION_QTY:
+      /*
+       * Declare color indexes for motion quantity graph
+       */
+      colors.background = gdImageColorAllocate(im, 255, 255, 255);
+      colors.line = gdImageColorAllocate(im, 0, 0, 0);
+      colors.title = gdImageColorAllocate(im, 0, 0, 0);
+      colors.grid = gdImageColorAllocate(im, 0, 0, 0);
+      colors.video_end = gdImageColorAllocate(im, 200, 200, 200);
+      colors.timecode = gdImageColorAllocate(im, 0, 0, 0);
+      colors.threshold = gdImageColorAllocate(im, 255, 0, 0);
+      break;
 
-  /*
-   * Graph's X-width (xsize) is width of video frame + 20 (for grid)
-   */
-  if (data.size() > xsize) {
-    xsize = data.size() + 20;
+    case IM_RGB_COLORS:
+      /*
+       * Declare color indexes for the RGB color graph
+       */
+      colors.background = gdImageColorAllocate(im, 255, 255, 255);
+      colors.line = gdImageColorAllocate(im, 0, 0, 0);
+      colors.title = gdImageColorAllocate(im, 0, 0, 0);
+      colors.grid = gdImageColorAllocate(im, 0, 0, 0);
+      colors.video_end = gdImageColorAllocate(im, 200, 200, 200);
+      colors.timecode = gdImageColorAllocate(im, 0, 0, 0);
+      colors.red = gdImageColorAllocate(im, 255, 0, 0);
+      colors.green = gdImageColorAllocate(im, 0, 255, 0);
+      colors.blue = gdImageColorAllocate(im, 0, 0, 255);
+      break;
+
+    case IM_HSV_COLORS:
+      /*
+       * Declare color indexes for the HSV graph
+       */
+      colors.background = gdTrueColor(255, 255, 255);
+      colors.line = gdTrueColor(0, 0, 0);
+      colors.title = gdTrueColor(0, 0, 0);
+      colors.grid = gdTrueColor(0, 0, 0);
+      colors.video_end = gdImageColorAllocate(im, 200, 200, 200);
+      colors.timecode = gdTrueColor(0, 0, 0);
+      colors.true_color = true;
+      break;
+
+    case IM_YUV_COLORS:
+      /*
+       * Declare color indexes for the YUV component graph
+       */
+      colors.background = gdImageColorAllocate(im, 255, 255, 255);
+      colors.line = gdImageColorAllocate(im, 0, 0, 0);
+      colors.title = gdImageColorAllocate(im, 0, 0, 0);
+      colors.grid = gdImageColorAllocate(im, 0, 0, 0);
+      colors.timecode = gdImageColorAllocate(im, 0, 0, 0);
+      colors.video_end = gdImageColorAllocate(im, 200, 200, 200);
+      colors.cy = gdImageColorAllocate(im, 127, 127, 127);
+      colors.cu = gdImageColorAllocate(im, 0, 0, 255);
+      colors.cv = gdImageColorAllocate(im, 255, 0, 0);
+      colors.bt601white = gdImageColorAllocate(im, 200, 200, 200);
+      colors.bt601black = gdImageColorAllocate(im, 200, 200, 200);
+      break;
+  }
+  return colors;
+}
+
+/*
+ * Graph's X-width (xsize) is width of video frame + 20 (for grid)
+ * When decimating, one column stands for several frames.
+ */
+void graph::prepare_render() {
+  size_t width = metrics.motion.size();
+  if (bounded || (target_width && width > target_width)) {
+    frames_per_column = reduce_series(columns, target_width);
+    width = columns[SERIES_MOTION].size();
+  }
+  if (width > xsize) {
+    xsize = width + 20;
+  }
+}
+
+/*
+ * Draw, encode and write one graph image. Every graph kind has its own
+ * image, colors and file, so they can be rendered concurrently.
+ */
+static const char *graph_titles[] = {"", "Quantity of movement", "RGB colors",
+                                     "HSV colorspace", "YCbCr components"};
+static const char *graph_files[] = {"", "/motion_qty", "/colors", "/hsv",
+                                    "/yuv"};
+
+void graph::render_graph(int kind) {
+  if (this->f->graph_svg) {
+    write_svg(kind);
+    return;
   }
 
   /*
-   * Create image buffers
-   *   Motion quantity graph: indexed colors
-   *   RGB color graph: indexed colors
+   * Create image buffer
+   *   Motion quantity, RGB and YUV graphs: indexed colors
    *   HSV graph: true color
    */
-  im_motion_qty = gdImageCreate(xsize, ysize);
-  im_colors_rgb = gdImageCreate(xsize, ysize);
-  im_colors_hsv = gdImageCreateTrueColor(xsize, ysize);
-  im_colors_yuv = gdImageCreate(xsize, ysize);
+  gdImagePtr im = kind == IM_HSV_COLORS ? gdImageCreateTrueColor(xsize, ysize)
+                                        : gdImageCreate(xsize, ysize);
+  graph_color colors = allocate_colors(im, kind);
 
-  /*
-   * Declare color indexes used for all images
-   * NOTE: This is currently not used, but necessary to keep the vector indexes
-   *       in line with their static numbers.
-   */
-  add_colorset(canvas_graph_colors);  // Add colorset. Index=0
+  draw_canvas(im, graph_titles[kind], colors);
+  if (!columns.empty()) {
+    draw_columns(im, kind, colors, columns, 0, columns[SERIES_MOTION].size(),
+                 xoffset);
+  } else {
+    draw_frames(im, kind, colors);
+  }
+  if (kind == IM_MOTION_QTY) {
+    /*
+     * Draw the threshold line
+     */
+    gdImageLine(im, xoffset, xaxis_offset - threshold, xsize - xoffset,
+                xaxis_offset - threshold, colors.threshold);
+  }
 
-  /*
-   * Declare color indexes for motion quantity graph
-   */
-  motion_qty_graph_colors.background =
-      gdImageColorAllocate(im_motion_qty, 255, 255, 255);
-  motion_qty_graph_colors.line = gdImageColorAllocate(im_motion_qty, 0, 0, 0);
-  motion_qty_graph_colors.title = gdImageColorAllocate(im_motion_qty, 0, 0, 0);
-  motion_qty_graph_colors.grid = gdImageColorAllocate(im_motion_qty, 0, 0, 0);
-  motion_qty_graph_colors.video_end =
-      gdImageColorAllocate(im_motion_qty, 200, 200, 200);
-  motion_qty_graph_colors.timecode =
-      gdImageColorAllocate(im_motion_qty, 0, 0, 0);
-  motion_qty_graph_colors.threshold =
-      gdImageColorAllocate(im_motion_qty, 255, 0, 0);
-  add_colorset(motion_qty_graph_colors);  // Add colorset. Index=1
+  string filename = global_path + graph_files[kind] + ".png";
+  FILE *fd = fopen(filename.c_str(), "wb");
+  if (fd != NULL) {
+    gdImagePng(im, fd);
+    fclose(fd);
+  } else {
+    cerr << "Cannot write graph " << filename << endl;
+  }
+  gdImageDestroy(im);
+}
 
-  /*
-   * Declare color indexes for the RGB color graph
-   */
-  rgb_graph_colors.background =
-      gdImageColorAllocate(im_colors_rgb, 255, 255, 255);
-  rgb_graph_colors.line = gdImageColorAllocate(im_colors_rgb, 0, 0, 0);
-  rgb_graph_colors.title = gdImageColorAllocate(im_colors_rgb, 0, 0, 0);
-  rgb_graph_colors.grid = gdImageColorAllocate(im_colors_rgb, 0, 0, 0);
-  rgb_graph_colors.video_end =
-      gdImageColorAllocate(im_colors_rgb, 200, 200, 200);
-  rgb_graph_colors.timecode = gdImageColorAllocate(im_colors_rgb, 0, 0, 0);
-  rgb_graph_colors.red = gdImageColorAllocate(im_colors_rgb, 255, 0, 0);
-  rgb_graph_colors.green = gdImageColorAllocate(im_colors_rgb, 0, 255, 0);
-  rgb_graph_colors.blue = gdImageColorAllocate(im_colors_rgb, 0, 0, 255);
-  add_colorset(rgb_graph_colors);  // Add colorset. Index=2
+/*
+ * Sample "i" of series "index": a single frame, or a decimated bucket
+ * in bounded memory mode
+ */
+series::bucket graph::sample(int index, size_t i) const {
+  series::bucket b;
+  if (bounded) {
+    return columns[index][i];
+  }
+  b.add(metrics.get(index, i));
+  return b;
+}
 
-  /*
-   * Declare color indexes for the HSV graph
-   */
-  hsv_graph_colors.background = gdTrueColor(255, 255, 255);
-  hsv_graph_colors.line = gdTrueColor(0, 0, 0);
-  hsv_graph_colors.title = gdTrueColor(0, 0, 0);
-  hsv_graph_colors.grid = gdTrueColor(0, 0, 0);
-  hsv_graph_colors.video_end =
-      gdImageColorAllocate(im_colors_hsv, 200, 200, 200);
-  hsv_graph_colors.timecode = gdTrueColor(0, 0, 0);
-  add_colorset(hsv_graph_colors);  // Add colorset. Index=3
+/*
+ * Vector output: write one graph as SVG in a single pass over its
+ * samples. Frames are reduced to at most SVG_WIDTH (or the target width)
+ * columns on the fly and every series becomes one min/max polyline, so
+ * the file size depends on the width only.
+ */
+void graph::write_svg(int kind) {
+  static const char *strokes[][3] = {{""},
+                                     {"#000000"},
+                                     {"#ff0000", "#00ff00", "#0000ff"},
+                                     {""},
+                                     {"#7f7f7f", "#0000ff", "#ff0000"}};
+  const int *ids = kind_series[kind];
+  size_t nseries = 0;
+  while (ids[nseries] >= 0) nseries++;
 
-  /*
-   * Declare color indexes for the YUV component graph
-   */
-  yuv_graph_colors.background =
-      gdImageColorAllocate(im_colors_yuv, 255, 255, 255);
-  yuv_graph_colors.line = gdImageColorAllocate(im_colors_yuv, 0, 0, 0);
-  yuv_graph_colors.title = gdImageColorAllocate(im_colors_yuv, 0, 0, 0);
-  yuv_graph_colors.grid = gdImageColorAllocate(im_colors_yuv, 0, 0, 0);
-  yuv_graph_colors.timecode = gdImageColorAllocate(im_colors_yuv, 0, 0, 0);
-  yuv_graph_colors.video_end =
-      gdImageColorAllocate(im_colors_yuv, 200, 200, 200);
-  yuv_graph_colors.cy = gdImageColorAllocate(im_colors_yuv, 127, 127, 127);
-  yuv_graph_colors.cu = gdImageColorAllocate(im_colors_yuv, 0, 0, 255);
-  yuv_graph_colors.cv = gdImageColorAllocate(im_colors_yuv, 255, 0, 0);
-  yuv_graph_colors.bt601white =
-      gdImageColorAllocate(im_colors_yuv, 200, 200, 200);
-  yuv_graph_colors.bt601black =
-      gdImageColorAllocate(im_colors_yuv, 200, 200, 200);
-  add_colorset(yuv_graph_colors);  // Add colorset. Index=4
+  const size_t n = bounded ? columns[ids[0]].size() : metrics.size(ids[0]);
+  const size_t width = min(n, target_width ? target_width : SVG_WIDTH);
+  const int svg_width = int(width) + 2 * xoffset;
 
-  /*
-   * Open file descriptors (POSIX C)
-   */
-  filename_motion_qty = global_path + "/motion_qty.png";
-  filename_rgb = global_path + "/colors.png";
-  filename_hsv = global_path + "/hsv.png";
-  filename_yuv = global_path + "/yuv.png";
+  string filename = global_path + graph_files[kind] + ".svg";
+  svg::writer doc;
+  if (!doc.open(filename, max(svg_width, 600), ysize)) {
+    cerr << "Cannot write graph " << filename << endl;
+    return;
+  }
+  doc.rect(0, 0, max(svg_width, 600), ysize, "#ffffff");
+  doc.text(max(svg_width, 600) / 2, 24, graph_titles[kind], "#000000");
+  doc.line(xoffset, xaxis_offset, svg_width - xoffset, xaxis_offset,
+           "#000000");  // x-axis
+  doc.line(xoffset, yoffset, xoffset, ysize - yoffset, "#000000");  // y-axis
 
-  fdmotion_qty = fopen(filename_motion_qty.c_str(), "wb");
-  if (this->f->draw_rgb_graph) {
-    fdgraph_rgb = fopen(filename_rgb.c_str(), "wb");
+  doc.begin_polylines(kind == IM_HSV_COLORS ? 0 : nseries);
+  vector<series::bucket> acc(nseries);
+  size_t column = 0;
+  for (size_t i = 0; i <= n; i++) {
+    const size_t c = i < n ? i * width / n : width;
+    if (c != column) {
+      const int x = xoffset + int(column);
+      if (kind == IM_HSV_COLORS) {
+        float r, g, b;
+        hsv_to_rgb(&r, &g, &b, acc[0].mean(), float(1), float(1));
+        doc.line(x, xaxis_offset - 1, x,
+                 xaxis_offset - 1 - int(acc[1].max * 255), int(r * 255),
+                 int(g * 255), int(b * 255));
+      } else {
+        for (size_t s = 0; s < nseries; s++) {
+          doc.point(s, x, xaxis_offset - int(acc[s].max));
+          if (int(acc[s].min) != int(acc[s].max)) {
+            doc.point(s, x, xaxis_offset - int(acc[s].min));
+          }
+        }
+      }
+      acc.assign(nseries, series::bucket());
+      column = c;
+    }
+    if (i == n) break;
+    for (size_t s = 0; s < nseries; s++) {
+      acc[s].merge(sample(ids[s], i));
+    }
   }
-  if (this->f->draw_hsv_graph) {
-    fdgraph_hsv = fopen(filename_hsv.c_str(), "wb");
+  if (kind != IM_HSV_COLORS) {
+    for (size_t s = 0; s < nseries; s++) {
+      // U and V are dashed, as in the PNG graph
+      doc.end_polyline(s, strokes[kind][s], kind == IM_YUV_COLORS && s > 0);
+    }
   }
-  if (this->f->draw_yuv_graph) {
-    fdgraph_yuv = fopen(filename_yuv.c_str(), "wb");
+
+  if (kind == IM_MOTION_QTY) {
+    doc.line(xoffset, xaxis_offset - threshold, svg_width - xoffset,
+             xaxis_offset - threshold, "#ff0000");
   }
+  doc.close();
 }
 
 /*
-* Create canvas for the graphs
-*/
-void graph::draw_all_canvas() {
-  draw_canvas(im_motion_qty, "Quantity of movement",
-              graph_colors[IM_MOTION_QTY]);
-  if (this->f->draw_rgb_graph) {
-    draw_canvas(im_colors_rgb, "RGB colors", graph_colors[IM_RGB_COLORS]);
+ * Start drawing and PNG encoding of every enabled graph, one task per
+ * image. The caller may write other output meanwhile and must call
+ * wait_render() before the graph is destroyed.
+ */
+void graph::render_async() {
+  prepare_render();
+
+  const int kinds[] = {IM_MOTION_QTY, IM_RGB_COLORS, IM_HSV_COLORS,
+                       IM_YUV_COLORS};
+  const bool enabled[] = {true, this->f->draw_rgb_graph,
+                          this->f->draw_hsv_graph, this->f->draw_yuv_graph};
+  for (int k = 0; k < 4; k++) {
+    if (enabled[k]) {
+      render_tasks.push_back(
+          std::async(std::launch::async, &graph::render_graph, this, kinds[k]));
+    }
   }
-  if (this->f->draw_hsv_graph) {
-    draw_canvas(im_colors_hsv, "HSV colorspace", graph_colors[IM_HSV_COLORS]);
+}
+
+void graph::wait_render() {
+  for (size_t i = 0; i < render_tasks.size(); i++) {
+    render_tasks[i].get();
   }
-  if (this->f->draw_yuv_graph) {
-    draw_canvas(im_colors_yuv, "YCbCr components", graph_colors[IM_YUV_COLORS]);
+  render_tasks.clear();
+
+  if (bounded) {
+    spill_motion.close();
+    spill_hsv.close();
   }
 }
 
@@ -214,7 +418,7 @@ void graph::draw_all_canvas() {
  * Draw common elements on graph canvas (background, grid, title, etc)
  */
 void graph::draw_canvas(gdImagePtr im, string title, graph_color colorset) {
-  int fps = this->f->get_fps();
+  int fps = max(1, int(this->f->get_fps()));
   int tick_length;
   bool is_second, is_minute, is_hour;
   int hour, minute, second, frame;
@@ -238,11 +442,30 @@ void graph::draw_canvas(gdImagePtr im, string title, graph_color colorset) {
     }
   }
 
+  /*
+   * Label every 10 seconds, or less often if labels would overlap
+   */
+  static const int label_steps[] = {10, 60, 300, 600, 1800, 3600, 7200};
+  int label_seconds = label_steps[0];
+  for (size_t i = 1; i < sizeof(label_steps) / sizeof(label_steps[0]) &&
+                     label_seconds * fps < 80 * frames_per_column;
+       i++) {
+    label_seconds = label_steps[i];
+  }
+  const bool draw_second_ticks = fps >= 3 * frames_per_column;
+
   for (int x = xoffset; x < xsize - xoffset; x++) {
-    // Calculate video position information:
-    frames = x - xoffset + 1;
+    // Calculate video position information. A column covers the frames
+    // [first, last]; it gets a tick if a full second falls into it.
+    const long first = long((x - xoffset) * frames_per_column) + 1;
+    const long last = long((x - xoffset + 1) * frames_per_column);
+    const long label_frames = long(label_seconds) * fps;
+    const long label_tick = ((first + label_frames - 1) / label_frames) * label_frames;
+    const bool is_label = label_tick <= last;
+
+    frames = is_label ? label_tick : ((first + fps - 1) / fps) * fps;
     frame = (frames % fps);
-    is_second = !frame;
+    is_second = frames <= last && (is_label || draw_second_ticks);
     is_minute = false;
     is_hour = false;
 
@@ -255,8 +478,8 @@ void graph::draw_canvas(gdImagePtr im, string title, graph_color colorset) {
       is_minute = !second;
       is_hour = !minute;
 
-      // Do something special every 10th second:
-      if (!(second % 10)) {
+      // Do something special at every label interval:
+      if (is_label) {
         tick_length = 10;
 
         // Write video position as grid label:
@@ -305,22 +528,6 @@ void graph::draw_canvas(gdImagePtr im, string title, graph_color colorset) {
   }
 }
 
-void graph::draw_datas() {
-  /*
-   * Loop for creation of data axes in the graph images
-   */
-  for (int i = 1; i < data.size() - 1; i++) {
-    gdImageLine(im_motion_qty, i - 1 + xoffset,
-                (-data[i - 1].global) + xaxis_offset, i + xoffset,
-                (-data[i].global) + xaxis_offset, graph_colors[IM_CANVAS].line);
-  }
-  /*
-   * Draw the threshold line
-   */
-  gdImageLine(im_motion_qty, xoffset, xaxis_offset - threshold, xsize - xoffset,
-              xaxis_offset - threshold, graph_colors[IM_MOTION_QTY].threshold);
-}
-
 void graph::hsv_to_rgb(float *r, float *g, float *b, float h, float s,
                        float v) {
   int i;
@@ -403,11 +610,14 @@ void graph::rgb_to_hsv(float r, float g, float b, float *h, float *s,
   if (*h < 0) *h += 360;
 }
 
-void graph::draw_color_datas() {
+/*
+ * Full resolution drawing: one column per frame
+ */
+void graph::draw_frames(gdImagePtr im, int kind, const graph_color &colors) {
   int hsv_color;
   float r, g, b;
   int frame_count;
-  int pos_x, pos_y;
+  int pos_x;
 
   int style_cu[2];
   int style_cv[2];
@@ -415,57 +625,60 @@ void graph::draw_color_datas() {
   /*
    * Initialize gd line style
    */
-  style_cu[0] = graph_colors[IM_YUV_COLORS].cu;
+  style_cu[0] = colors.cu;
   style_cu[1] = gdTransparent;
-  style_cv[0] = graph_colors[IM_YUV_COLORS].cv;
+  style_cv[0] = colors.cv;
   style_cv[1] = gdTransparent;
 
-  frame_count = data.size();  // Number of data points to draw
+  frame_count = metrics.motion.size();  // Number of data points to draw
 
   /*
-   * Draw color graphs (RGB, HSV)
+   * Loop for creation of data axes in the graph images
    */
   for (int i = 0; i < (frame_count - 1); i++) {
     pos_x = i + xoffset;
 
-    // RGB:
-    if (this->f->draw_rgb_graph) {
-      gdImageLine(im_colors_rgb, pos_x, xaxis_offset - colors_rgb[i].c1,
-                  pos_x + 1, xaxis_offset - colors_rgb[i + 1].c1,
-                  graph_colors[IM_RGB_COLORS].red);
-      gdImageLine(im_colors_rgb, pos_x, xaxis_offset - colors_rgb[i].c2,
-                  pos_x + 1, xaxis_offset - colors_rgb[i + 1].c2,
-                  graph_colors[IM_RGB_COLORS].green);
-      gdImageLine(im_colors_rgb, pos_x, xaxis_offset - colors_rgb[i].c3,
-                  pos_x + 1, xaxis_offset - colors_rgb[i + 1].c3,
-                  graph_colors[IM_RGB_COLORS].blue);
-    }
+    switch (kind) {
+      case IM_MOTION_QTY:
+        if (i > 0) {
+          gdImageLine(im, i - 1 + xoffset,
+                      (-metrics.motion[i - 1]) + xaxis_offset, i + xoffset,
+                      (-metrics.motion[i]) + xaxis_offset, colors.line);
+        }
+        break;
 
-    // HSV:
-    if (this->f->draw_hsv_graph) {
-      hsv_to_rgb(&r, &g, &b, colors_hsv[i].c1, float(1), float(1));
-      hsv_color = gdTrueColor(int(r * 255), int(g * 255),
-                              int(b * 255));  // Set the drawing color RGB
-                                              // values according to
-                                              // "hsv_to_rgb()"
-      gdImageLine(
-          im_colors_hsv, i + xoffset, (0) + xaxis_offset - 1, i + xoffset,
-          (int((-colors_hsv[i].c2) * 255)) + xaxis_offset - 1, hsv_color);
-    }
+      case IM_RGB_COLORS:
+        gdImageLine(im, pos_x, xaxis_offset - metrics.red[i], pos_x + 1,
+                    xaxis_offset - metrics.red[i + 1], colors.red);
+        gdImageLine(im, pos_x, xaxis_offset - metrics.green[i], pos_x + 1,
+                    xaxis_offset - metrics.green[i + 1], colors.green);
+        gdImageLine(im, pos_x, xaxis_offset - metrics.blue[i], pos_x + 1,
+                    xaxis_offset - metrics.blue[i + 1], colors.blue);
+        break;
+
+      case IM_HSV_COLORS:
+        hsv_to_rgb(&r, &g, &b, metrics.get(SERIES_HUE, i), float(1),
+                   float(1));
+        hsv_color = gdTrueColor(int(r * 255), int(g * 255),
+                                int(b * 255));  // Set the drawing color RGB
+                                                // values according to
+                                                // "hsv_to_rgb()"
+        gdImageLine(im, i + xoffset, (0) + xaxis_offset - 1, i + xoffset,
+                    (int(-metrics.get(SERIES_SATURATION, i) * 255)) +
+                        xaxis_offset - 1,
+                    hsv_color);
+        break;
 
-    // YUV:
-    if (this->f->draw_yuv_graph) {
-      printf("YUV: %d, %d, %d\n", colors_yuv[i].c1, colors_yuv[i].c2,
-             colors_yuv[i].c3);  // DELME
-      gdImageLine(im_colors_yuv, pos_x, xaxis_offset - colors_yuv[i].c1,
-                  pos_x + 1, xaxis_offset - colors_yuv[i + 1].c1,
-                  graph_colors[IM_YUV_COLORS].cy);
-      gdImageSetStyle(im_colors_yuv, style_cu, sizeof(style_cu));
-      gdImageLine(im_colors_yuv, pos_x, xaxis_offset - colors_yuv[i].c2,
-                  pos_x + 1, xaxis_offset - colors_yuv[i + 1].c2, gdStyled);
-      gdImageSetStyle(im_colors_yuv, style_cv, sizeof(style_cv));
-      gdImageLine(im_colors_yuv, pos_x, xaxis_offset - colors_yuv[i].c3,
-                  pos_x + 1, xaxis_offset - colors_yuv[i + 1].c3, gdStyled);
+      case IM_YUV_COLORS:
+        gdImageLine(im, pos_x, xaxis_offset - metrics.y[i], pos_x + 1,
+                    xaxis_offset - metrics.y[i + 1], colors.cy);
+        gdImageSetStyle(im, style_cu, 2);
+        gdImageLine(im, pos_x, xaxis_offset - metrics.u[i], pos_x + 1,
+                    xaxis_offset - metrics.u[i + 1], gdStyled);
+        gdImageSetStyle(im, style_cv, 2);
+        gdImageLine(im, pos_x, xaxis_offset - metrics.v[i], pos_x + 1,
+                    xaxis_offset - metrics.v[i + 1], gdStyled);
+        break;
     }
   }
 }
@@ -476,20 +689,412 @@ void graph::write_xml(string filename) {
           "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<iri>\n<frame>\n"
           "<!-- m=movement, r/g/b=RGB values, s=saturation -->\n");
 
+  if (bounded) {
+    write_decimated_xml(fd_xml);
+    fprintf(fd_xml, "</frame>\n</iri>");
+    fclose(fd_xml);
+    return;
+  }
+
   // Write video measurement data for every second:
-  for (int i = 0; int(double(i) * (f->fps)) < data.size() - 1; i++) {
+  const bool have_hsv = !metrics.hue.empty();
+  for (int i = 0; int(double(i) * (f->fps)) + 1 < metrics.motion.size(); i++) {
     int index = int(double(i) * (f->fps));
 
     float r;
     float g;
     float b;
 
-    hsv_to_rgb(&r, &g, &b, colors_hsv[index].c1, float(1), float(1));
+    const float hue = have_hsv ? metrics.get(SERIES_HUE, index) : 0;
+    const float saturation =
+        have_hsv ? metrics.get(SERIES_SATURATION, index) : 0;
+
+    hsv_to_rgb(&r, &g, &b, hue, float(1), float(1));
 
     fprintf(fd_xml, "<v m=\"%d\" r=\"%d\" g=\"%d\" b=\"%d\" s=\"%d\" />\n",
-            data[index].global, int(r * 255), int(g * 255), int(b * 255),
-            int(colors_hsv[index].c2 * 100));
+            metrics.motion[index], int(r * 255), int(g * 255), int(b * 255),
+            int(saturation * 100));
   }
   fprintf(fd_xml, "</frame>\n</iri>");
   fclose(fd_xml);
 }
+
+/*
+ * Reduce every series to one bucket per graph column. Bounded mode takes
+ * the live decimators, regrouped to the coarsest one since series pushed
+ * one frame more may have folded once more. Otherwise the in-memory
+ * series are reduced to "width" columns in a single pass. Returns the
+ * number of frames per column.
+ */
+double graph::reduce_series(vector<vector<series::bucket> > &out,
+                            size_t width) {
+  out.assign(SERIES_COUNT, vector<series::bucket>());
+
+  if (bounded) {
+    unsigned int per_column = decimated[SERIES_MOTION].frames_per_bucket();
+    for (int i = 0; i < SERIES_COUNT; i++) {
+      if (decimated[i].frames()) {
+        per_column = max(per_column, decimated[i].frames_per_bucket());
+      }
+    }
+    for (int i = 0; i < SERIES_COUNT; i++) {
+      out[i] = series::regroup(
+          decimated[i].buckets(),
+          max(1U, per_column / decimated[i].frames_per_bucket()));
+    }
+    return per_column;
+  }
+
+  const size_t n = metrics.motion.size();
+  for (int i = 0; i < SERIES_COUNT; i++) {
+    if (metrics.size(i) < n || metrics.size(i) == 0) continue;  // not drawn
+    out[i] = series::reduce(
+        n, width, [this, i](size_t j) { return metrics.get(i, j); });
+  }
+  return n > width ? double(n) / width : 1;
+}
+
+/*
+ * One column of a line graph: the min/max range of the frames it covers,
+ * joined to the mean of the column before when there is one. With a frame
+ * per column this is the line from frame to frame of draw_frames().
+ */
+static void draw_column(gdImagePtr im, int x, int axis,
+                        const vector<series::bucket> &d, size_t i,
+                        int color) {
+  if (i > 0) {
+    gdImageLine(im, x - 1, axis - int(d[i - 1].mean()), x,
+                axis - int(d[i].mean()), color);
+  }
+  gdImageLine(im, x, axis - int(d[i].max), x, axis - int(d[i].min), color);
+}
+
+/*
+ * Decimated drawing: every column shows the min/max range of the frames
+ * it covers, so single-frame spikes stay visible. Draws the columns
+ * [first, first + count) of graph "kind" starting at image column x0; a
+ * column before "first" is only joined to.
+ */
+void graph::draw_columns(gdImagePtr im, int kind, const graph_color &colors,
+                         const vector<vector<series::bucket> > &cols,
+                         size_t first, size_t count, int x0) {
+  int style_cu[2] = {colors.cu, gdTransparent};
+  int style_cv[2] = {colors.cv, gdTransparent};
+  float r, g, b;
+
+  switch (kind) {
+    case IM_MOTION_QTY: {
+      const vector<series::bucket> &motion = cols[SERIES_MOTION];
+      for (size_t i = first; i < first + count && i < motion.size(); i++) {
+        draw_column(im, x0 + int(i - first), xaxis_offset, motion, i,
+                    colors.line);
+      }
+      break;
+    }
+
+    case IM_RGB_COLORS: {
+      const int channels[] = {SERIES_RED, SERIES_GREEN, SERIES_BLUE};
+      const int channel_colors[] = {colors.red, colors.green, colors.blue};
+      for (int c = 0; c < 3; c++) {
+        const vector<series::bucket> &d = cols[channels[c]];
+        for (size_t i = first; i < first + count && i < d.size(); i++) {
+          draw_column(im, x0 + int(i - first), xaxis_offset, d, i,
+                      channel_colors[c]);
+        }
+      }
+      break;
+    }
+
+    case IM_HSV_COLORS: {
+      const vector<series::bucket> &hue = cols[SERIES_HUE];
+      const vector<series::bucket> &sat = cols[SERIES_SATURATION];
+      for (size_t i = first;
+           i < first + count && i < sat.size() && i < hue.size(); i++) {
+        const int x = x0 + int(i - first);
+        hsv_to_rgb(&r, &g, &b, hue[i].mean(), float(1), float(1));
+        gdImageLine(im, x, xaxis_offset - 1, x,
+                    xaxis_offset - 1 - int(sat[i].max * 255),
+                    gdTrueColor(int(r * 255), int(g * 255), int(b * 255)));
+      }
+      break;
+    }
+
+    case IM_YUV_COLORS: {
+      const vector<series::bucket> &cy = cols[SERIES_Y];
+      const vector<series::bucket> &cu = cols[SERIES_U];
+      const vector<series::bucket> &cv = cols[SERIES_V];
+      for (size_t i = first; i < first + count && i < cy.size() &&
+                             i < cu.size() && i < cv.size();
+           i++) {
+        const int x = x0 + int(i - first);
+        draw_column(im, x, xaxis_offset, cy, i, colors.cy);
+        gdImageSetStyle(im, style_cu, 2);
+        draw_column(im, x, xaxis_offset, cu, i, gdStyled);
+        gdImageSetStyle(im, style_cv, 2);
+        draw_column(im, x, xaxis_offset, cv, i, gdStyled);
+      }
+      break;
+    }
+  }
+}
+
+/*
+ * Bounded memory mode: read the spilled series back sequentially and
+ * write the same once-per-second samples as the in-memory path.
+ */
+void graph::write_decimated_xml(FILE *fd) {
+  uint16_t motion = 0;
+  uint16_t hsv[2] = {0, 0};
+  size_t pos = 0;
+  const bool have_hsv = spill_hsv.size() > 0;
+
+  spill_motion.rewind();
+  spill_hsv.rewind();
+  for (int i = 0; size_t(double(i) * (f->fps)) + 1 < spill_motion.size(); i++) {
+    size_t index = size_t(double(i) * (f->fps));
+
+    for (; pos <= index; pos++) {
+      spill_motion.read(&motion);
+      if (have_hsv) spill_hsv.read(hsv);
+    }
+
+    float r;
+    float g;
+    float b;
+
+    hsv_to_rgb(&r, &g, &b, metric_table::hue_degrees(hsv[0]), float(1),
+               float(1));
+
+    fprintf(fd, "<v m=\"%d\" r=\"%d\" g=\"%d\" b=\"%d\" s=\"%d\" />\n",
+            motion, int(r * 255), int(g * 255), int(b * 255),
+            int(metric_table::saturation_ratio(hsv[1]) * 100));
+  }
+}
+
+/*
+ * Incremental rendering: draw every graph in chunks of TILE_WIDTH frames
+ * on a background thread while the film is still being decoded:
+ *   chunks/<graph>/<index>.png, one column per frame
+ *   chunks/index.json, written by finish_chunks()
+ * Must be called before the first value is pushed.
+ */
+void graph::start_chunks() {
+  if (chunked) return;
+  make_dir(global_path + "/chunks");
+  staging.assign(SERIES_COUNT, vector<series::bucket>());
+  chunk_tail.assign(SERIES_COUNT, series::bucket());
+  for (int k = 0; k <= IM_YUV_COLORS; k++) {
+    chunk_count[k] = 0;
+  }
+  chunk_stop = false;
+  chunked = true;
+  chunk_thread = std::thread(&graph::chunk_worker, this);
+}
+
+/*
+ * Move the staged values of one graph into a job for the chunk thread
+ */
+void graph::queue_chunk(int kind) {
+  chunk_job job;
+  job.kind = kind;
+  job.index = chunk_count[kind]++;
+  job.first = job.index > 0 ? 1 : 0;
+  job.cols.resize(SERIES_COUNT);
+  for (int i = 0; kind_series[kind][i] >= 0; i++) {
+    const int s = kind_series[kind][i];
+    job.cols[s].swap(staging[s]);
+    staging[s].reserve(TILE_WIDTH);
+    if (job.first) {
+      job.cols[s].insert(job.cols[s].begin(), chunk_tail[s]);
+    }
+    if (!job.cols[s].empty()) chunk_tail[s] = job.cols[s].back();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    chunk_queue.push_back(std::move(job));
+  }
+  chunk_ready.notify_one();
+}
+
+void graph::chunk_worker() {
+  static const char *names[] = {"", "motion_qty", "colors", "hsv", "yuv"};
+
+  for (;;) {
+    chunk_job job;
+    {
+      std::unique_lock<std::mutex> lock(chunk_mutex);
+      chunk_ready.wait(lock,
+                       [this] { return chunk_stop || !chunk_queue.empty(); });
+      if (chunk_queue.empty()) return;
+      job = std::move(chunk_queue.front());
+      chunk_queue.pop_front();
+    }
+
+    string chunk_path = global_path + "/chunks/" + names[job.kind];
+    if (job.index == 0) {
+      make_dir(chunk_path);
+    }
+
+    gdImagePtr im = job.kind == IM_HSV_COLORS
+                        ? gdImageCreateTrueColor(TILE_WIDTH, ysize)
+                        : gdImageCreate(TILE_WIDTH, ysize);
+    graph_color colors = allocate_colors(im, job.kind);
+    gdImageFilledRectangle(im, 0, 0, TILE_WIDTH, ysize, colors.background);
+    draw_columns(im, job.kind, colors, job.cols, job.first, TILE_WIDTH, 0);
+    if (job.kind == IM_MOTION_QTY) {
+      gdImageLine(im, 0, xaxis_offset - threshold, TILE_WIDTH - 1,
+                  xaxis_offset - threshold, colors.threshold);
+    }
+
+    string chunk = fmt::format("{}/{}.png", chunk_path, job.index);
+    FILE *fd_chunk = fopen(chunk.c_str(), "wb");
+    if (fd_chunk != NULL) {
+      gdImagePng(im, fd_chunk);
+      fclose(fd_chunk);
+    }
+    gdImageDestroy(im);
+  }
+}
+
+/*
+ * Queue the last partial chunks, wait for the chunk thread and write the
+ * chunk index.
+ */
+void graph::finish_chunks() {
+  static const char *names[] = {"", "motion_qty", "colors", "hsv", "yuv"};
+  static const int first_series[] = {-1, SERIES_MOTION, SERIES_RED,
+                                     SERIES_HUE, SERIES_Y};
+
+  if (!chunked) return;
+  const size_t frames =
+      chunk_count[IM_MOTION_QTY] * TILE_WIDTH + staging[SERIES_MOTION].size();
+  for (int k = IM_MOTION_QTY; k <= IM_YUV_COLORS; k++) {
+    if (!staging[first_series[k]].empty()) {
+      queue_chunk(k);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    chunk_stop = true;
+  }
+  chunk_ready.notify_one();
+  chunk_thread.join();
+  chunked = false;
+
+  string index_path = global_path + "/chunks/index.json";
+  FILE *fd_index = fopen(index_path.c_str(), "w");
+  if (fd_index == NULL) {
+    f->shotlog("Cannot write chunk index " + index_path);
+    return;
+  }
+  fprintf(fd_index,
+          "{\n  \"frames\": %zu,\n  \"fps\": %g,\n  \"chunk_width\": %d,\n"
+          "  \"chunk_height\": %d,\n  \"xaxis\": %d,\n  \"threshold\": %d,\n"
+          "  \"path\": \"{graph}/{index}.png\",\n  \"graphs\": {",
+          frames, f->fps, TILE_WIDTH, ysize, xaxis_offset, threshold);
+  bool first_graph = true;
+  for (int k = IM_MOTION_QTY; k <= IM_YUV_COLORS; k++) {
+    if (!chunk_count[k]) continue;
+    fprintf(fd_index, "%s\"%s\": %zu", first_graph ? "" : ", ", names[k],
+            chunk_count[k]);
+    first_graph = false;
+  }
+  fprintf(fd_index, "}\n}\n");
+  fclose(fd_index);
+}
+
+/*
+ * Write the graphs as a tile pyramid for zoomable timelines:
+ *   tiles/<graph>/<level>/<index>.png, TILE_WIDTH columns per tile
+ *   tiles/manifest.json
+ * Level 0 has one column per frame (per decimated bucket in bounded
+ * mode); every further level merges pairs of columns of the previous
+ * one, until the whole film fits into a single tile. Total work is
+ * linear in the number of frames.
+ */
+void graph::write_tiles() {
+  static const int kinds[] = {IM_MOTION_QTY, IM_RGB_COLORS, IM_HSV_COLORS,
+                              IM_YUV_COLORS};
+  static const char *names[] = {"motion_qty", "colors", "hsv", "yuv"};
+  const bool enabled[] = {true, this->f->draw_rgb_graph,
+                          this->f->draw_hsv_graph, this->f->draw_yuv_graph};
+
+  string tiles_path = global_path + "/tiles";
+  make_dir(tiles_path);
+
+  vector<vector<series::bucket> > level;
+  double per_column = reduce_series(level, bounded ? 0 : metrics.motion.size());
+
+  FILE *fd_manifest = fopen((tiles_path + "/manifest.json").c_str(), "w");
+  if (fd_manifest == NULL) {
+    f->shotlog("Cannot write tile manifest in " + tiles_path);
+    return;
+  }
+  fprintf(fd_manifest,
+          "{\n  \"frames\": %zu,\n  \"fps\": %g,\n  \"tile_width\": %d,\n"
+          "  \"tile_height\": %d,\n  \"xaxis\": %d,\n  \"threshold\": %d,\n"
+          "  \"path\": \"{graph}/{level}/{index}.png\",\n  \"graphs\": [",
+          bounded ? decimated[SERIES_MOTION].frames() : metrics.motion.size(),
+          f->fps,
+          TILE_WIDTH, ysize, xaxis_offset, threshold);
+  bool first_graph = true;
+  for (int k = 0; k < 4; k++) {
+    if (!enabled[k]) continue;
+    fprintf(fd_manifest, "%s\"%s\"", first_graph ? "" : ", ", names[k]);
+    first_graph = false;
+    make_dir(tiles_path + "/" + names[k]);
+  }
+  fprintf(fd_manifest, "],\n  \"levels\": [\n");
+
+  for (int l = 0;; l++) {
+    const size_t ncolumns = level[SERIES_MOTION].size();
+    const size_t ntiles = max<size_t>(1, (ncolumns + TILE_WIDTH - 1) / TILE_WIDTH);
+
+    for (int k = 0; k < 4; k++) {
+      if (!enabled[k]) continue;
+      string level_path = fmt::format("{}/{}/{}", tiles_path, names[k], l);
+      make_dir(level_path);
+
+      for (size_t t = 0; t < ntiles; t++) {
+        gdImagePtr im = kinds[k] == IM_HSV_COLORS
+                            ? gdImageCreateTrueColor(TILE_WIDTH, ysize)
+                            : gdImageCreate(TILE_WIDTH, ysize);
+        graph_color colors = allocate_colors(im, kinds[k]);
+        gdImageFilledRectangle(im, 0, 0, TILE_WIDTH, ysize, colors.background);
+        draw_columns(im, kinds[k], colors, level, t * TILE_WIDTH, TILE_WIDTH, 0);
+        if (kinds[k] == IM_MOTION_QTY) {
+          gdImageLine(im, 0, xaxis_offset - threshold, TILE_WIDTH - 1,
+                      xaxis_offset - threshold, colors.threshold);
+        }
+
+        string tile = fmt::format("{}/{}.png", level_path, t);
+        FILE *fd_tile = fopen(tile.c_str(), "wb");
+        if (fd_tile != NULL) {
+          gdImagePng(im, fd_tile);
+          fclose(fd_tile);
+        }
+        gdImageDestroy(im);
+      }
+    }
+
+    fprintf(fd_manifest,
+            "    {\"level\": %d, \"frames_per_column\": %g, "
+            "\"columns\": %zu, \"tiles\": %zu}",
+            l, per_column, ncolumns, ntiles);
+
+    if (ncolumns <= TILE_WIDTH) {
+      fprintf(fd_manifest, "\n");
+      break;
+    }
+    fprintf(fd_manifest, ",\n");
+
+    for (int i = 0; i < SERIES_COUNT; i++) {
+      level[i] = series::regroup(level[i], 2);
+    }
+    per_column *= 2;
+  }
+
+  fprintf(fd_manifest, "  ]\n}\n");
+  fclose(fd_manifest);
+}
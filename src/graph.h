@@ -6,16 +6,24 @@
 #ifndef __GRAPH_H__
 #define __GRAPH_H__
 
+#include <stdint.h>
 #include <vector>
 #include <algorithm>
 #include <string>
 #include <gd.h>
 #include <gdfontl.h>
 #include <iostream>
+#include <future>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include <film.h>
 #include <processing.h>
-#define SIZE_DATA 180000
+#include <series.h>
+#define TILE_WIDTH 256
+#define SVG_WIDTH 8192
 #define JPG 1
 #define PNG 2
 #define BMP 3
@@ -29,16 +37,68 @@
 /* True color values */
 #define IM_CANVAS_TRUE (IM_CANVAS + 0x9)
 
+/* Index of decimated series (bounded memory mode) */
+#define SERIES_MOTION 0
+#define SERIES_RED 1
+#define SERIES_GREEN 2
+#define SERIES_BLUE 3
+#define SERIES_HUE 4
+#define SERIES_SATURATION 5
+#define SERIES_Y 6
+#define SERIES_U 7
+#define SERIES_V 8
+#define SERIES_COUNT 9
+
 using namespace std;
 
-struct dataframe {
-  int global;
-  int red;
-  int green;
-  int blue;
-  float hue;
-  float saturation;
-  float value;
+/*
+ * Per-frame metrics as a structure of arrays, one column per series,
+ * each in the smallest type covering its range:
+ *   motion: per-pixel sum of RGB differences, 0..765
+ *   RGB and YUV averages: 0..255
+ *   hue: centidegrees, 0..35999 (0 when undefined)
+ *   saturation: 0..1 scaled to 0..65535
+ */
+struct metric_table {
+  vector<uint16_t> motion;
+  vector<uint8_t> red, green, blue;
+  vector<uint16_t> hue, saturation;
+  vector<uint8_t> y, u, v;
+
+  void reserve(size_t frames, bool colors, bool yuv);
+  size_t size(int series) const;
+  size_t memory_usage() const;
+
+  /* Value of series "index" at frame "i", in the original units */
+  inline float get(int index, size_t i) const {
+    switch (index) {
+      case SERIES_MOTION: return motion[i];
+      case SERIES_RED: return red[i];
+      case SERIES_GREEN: return green[i];
+      case SERIES_BLUE: return blue[i];
+      case SERIES_HUE: return hue_degrees(hue[i]);
+      case SERIES_SATURATION: return saturation_ratio(saturation[i]);
+      case SERIES_Y: return y[i];
+      case SERIES_U: return u[i];
+      case SERIES_V: return v[i];
+    }
+    return 0;
+  }
+
+  static inline uint16_t to_motion(int val) {
+    return uint16_t(min(max(val, 0), 65535));
+  }
+  static inline uint8_t to_byte(int val) {
+    return uint8_t(min(max(val, 0), 255));
+  }
+  static inline uint16_t to_hue(float h) {
+    return h < 0 ? 0 : uint16_t(min(h, 359.99f) * 100 + 0.5f);
+  }
+  static inline uint16_t to_saturation(float s) {
+    return uint16_t(min(max(s, 0.0f), 1.0f) * 65535 + 0.5f);
+  }
+  static inline float hue_degrees(uint16_t h) { return h / 100.0f; }
+  static inline float saturation_ratio(uint16_t s) { return s / 65535.0f; }
 };
 
 class film;
@@ -46,17 +106,7 @@ class film;
 class graph {
   /* Private properties for class-internal functions */
  private:
-  /* GD Image pointers */
-  gdImagePtr im_motion_qty;
-  gdImagePtr im_colors_rgb;
-  gdImagePtr im_colors_hsv;
-  gdImagePtr im_colors_yuv;
-
   FILE *pngout;
-  string filename_motion_qty;
-  string filename_rgb;
-  string filename_hsv;
-  string filename_yuv;
 
   string global_path;
   int size;
@@ -82,34 +132,54 @@ class graph {
   int xaxis_offset;
   bool grid;
   int ptr;
-  /* Graph file handles */
-  FILE *fdmotion_qty;
-  FILE *fdgraph_rgb;
-  FILE *fdgraph_hsv;
-  FILE *fdgraph_yuv;
+  /* Pending graph image renderings */
+  vector<std::future<void> > render_tasks;
   /* XML file handles */
   FILE *fd_xml;
 
   film *f;
-  vector<dataframe> data;
+  metric_table metrics;
 
-  /* Pixel color struct */
-  struct pixel_color {
-    int c1;
-    int c2;
-    int c3;
-  };
+  /*
+   * Bounded memory mode: per-frame values go to disk and only a
+   * fixed-width decimated copy is kept for drawing.
+   */
+  bool bounded;
+  vector<series::decimator> decimated;
 
-  struct pixel_true_color {
-    float c1;
-    float c2;
-    float c3;
-  };
+  /*
+   * Decimated rendering: one min/max/mean bucket per series and column,
+   * either from the bounded mode or reduced to target_width columns.
+   */
+  size_t target_width;
+  double frames_per_column;
+  vector<vector<series::bucket> > columns;
+  // Only what the decimated video XML reads back; the colour graphs are
+  // drawn from the decimated buckets
+  series::spill_file spill_motion;
+  series::spill_file spill_hsv;
 
-  /* Create variables for storing color values */
-  vector<pixel_color> colors_yuv;
-  vector<pixel_color> colors_rgb;
-  vector<pixel_true_color> colors_hsv;
+  /*
+   * Incremental rendering: values are staged per series and every
+   * TILE_WIDTH frames of a graph are handed to a background thread that
+   * draws and writes them as one chunk image.
+   */
+  struct chunk_job {
+    int kind;
+    size_t index;
+    size_t first;  // 1 when cols starts with the previous chunk's last value
+    vector<vector<series::bucket> > cols;
+  };
+  bool chunked;
+  vector<vector<series::bucket> > staging;
+  // Last value of each series in the previous chunk, to join the chunks
+  vector<series::bucket> chunk_tail;
+  size_t chunk_count[IM_YUV_COLORS + 1];
+  deque<chunk_job> chunk_queue;
+  std::mutex chunk_mutex;
+  std::condition_variable chunk_ready;
+  std::thread chunk_thread;
+  bool chunk_stop;
 
   /* Graph colors */
   struct graph_color {
@@ -133,44 +203,89 @@ class graph {
 
     bool true_color;
   };
-  vector<graph_color> graph_colors;
 
   void draw_canvas(gdImagePtr im, string title, graph_color colorset);
+  void draw_frames(gdImagePtr im, int kind, const graph_color &colors);
+  graph_color allocate_colors(gdImagePtr im, int kind);
+  void draw_columns(gdImagePtr im, int kind, const graph_color &colors,
+                    const vector<vector<series::bucket> > &cols, size_t first,
+                    size_t count, int x0);
+  double reduce_series(vector<vector<series::bucket> > &out, size_t width);
+  void prepare_render();
+  void render_graph(int kind);
+  series::bucket sample(int index, size_t i) const;
+  void write_svg(int kind);
+  void write_decimated_xml(FILE *fd);
+  void queue_chunk(int kind);
+  void chunk_worker();
   float MAX(float a, float b, float c);
   float MIN(float a, float b, float c);
 
  public:
-  void save();
-  void draw_all_canvas();
-  void draw_datas();
-  void draw_color_datas();
-  void init_gd();
+  void render_async();
+  void wait_render();
   void rgb_to_hsv(const float r, const float g, const float b, float *h,
                   float *s, float *v);
   void hsv_to_rgb(float *r, float *g, float *b, const float h, const float s,
                   const float v);
   void set_color(int, int, int);
   void write_xml(string filename);
+  void write_tiles();
+  bool set_bounded(size_t columns);
+  void reserve_frames(size_t frames);
+  void start_chunks();
+  void finish_chunks();
+  size_t memory_usage() const;
   ~graph();
   graph(int x, int y, string filename, int threshold, film *farg);
   graph(int threshold, film *farg);
 
-  inline void push_data(int val) {
-    dataframe frame;
-    frame.global = val;
-    data.push_back(frame);
+  inline bool is_bounded() const { return bounded; }
+  inline bool is_chunked() const { return chunked; }
+  inline void set_target_width(size_t width) { target_width = width; }
+
+  inline void stage(int index, float val) {
+    staging[index].push_back(series::bucket());
+    staging[index].back().add(val);
   }
 
-  inline void add_colorset(graph_color graph_color) {
-    graph_colors.push_back(graph_color);
+  inline void push_data(int val) {
+    const uint16_t motion = metric_table::to_motion(val);
+    if (chunked) {
+      stage(SERIES_MOTION, motion);
+      if (staging[SERIES_MOTION].size() == TILE_WIDTH) {
+        queue_chunk(IM_MOTION_QTY);
+      }
+    }
+    if (bounded) {
+      spill_motion.append(&motion);
+      decimated[SERIES_MOTION].push(motion);
+      return;
+    }
+    metrics.motion.push_back(motion);
   }
 
   inline void push_yuv(int cy, int cu, int cv) {
-    pixel_color yuv_components;
-    yuv_components.c1 = cy;
-    yuv_components.c2 = cu;
-    yuv_components.c3 = cv;
-    colors_yuv.push_back(yuv_components);
+    const uint8_t yuv[3] = {metric_table::to_byte(cy),
+                            metric_table::to_byte(cu),
+                            metric_table::to_byte(cv)};
+    if (chunked) {
+      stage(SERIES_Y, yuv[0]);
+      stage(SERIES_U, yuv[1]);
+      stage(SERIES_V, yuv[2]);
+      if (staging[SERIES_Y].size() == TILE_WIDTH) {
+        queue_chunk(IM_YUV_COLORS);
+      }
+    }
+    if (bounded) {
+      decimated[SERIES_Y].push(yuv[0]);
+      decimated[SERIES_U].push(yuv[1]);
+      decimated[SERIES_V].push(yuv[2]);
+      return;
+    }
+    metrics.y.push_back(yuv[0]);
+    metrics.u.push_back(yuv[1]);
+    metrics.v.push_back(yuv[2]);
   }
 
   inline void push_yuv(processing::YUVTriple yuv) {
@@ -178,18 +293,48 @@ class graph {
   }
 
   inline void push_rgb(int red, int green, int blue) {
-    pixel_color rgb_components;
-    rgb_components.c1 = red;
-    rgb_components.c2 = green;
-    rgb_components.c3 = blue;
-    colors_rgb.push_back(rgb_components);
+    const uint8_t rgb[3] = {metric_table::to_byte(red),
+                            metric_table::to_byte(green),
+                            metric_table::to_byte(blue)};
+    if (chunked) {
+      stage(SERIES_RED, rgb[0]);
+      stage(SERIES_GREEN, rgb[1]);
+      stage(SERIES_BLUE, rgb[2]);
+      if (staging[SERIES_RED].size() == TILE_WIDTH) {
+        queue_chunk(IM_RGB_COLORS);
+      }
+    }
+    if (bounded) {
+      decimated[SERIES_RED].push(rgb[0]);
+      decimated[SERIES_GREEN].push(rgb[1]);
+      decimated[SERIES_BLUE].push(rgb[2]);
+      return;
+    }
+    metrics.red.push_back(rgb[0]);
+    metrics.green.push_back(rgb[1]);
+    metrics.blue.push_back(rgb[2]);
   }
 
   inline void push_rgb_to_hsv(int red, int green, int blue) {
-    pixel_true_color hsv_components;
-    rgb_to_hsv(float(red), float(green), float(blue), &(hsv_components.c1),
-               &(hsv_components.c2), &(hsv_components.c3));
-    colors_hsv.push_back(hsv_components);
+    float h, s, v;
+    rgb_to_hsv(float(red), float(green), float(blue), &h, &s, &v);
+    const uint16_t hsv[2] = {metric_table::to_hue(h),
+                             metric_table::to_saturation(s)};
+    if (chunked) {
+      stage(SERIES_HUE, metric_table::hue_degrees(hsv[0]));
+      stage(SERIES_SATURATION, metric_table::saturation_ratio(hsv[1]));
+      if (staging[SERIES_HUE].size() == TILE_WIDTH) {
+        queue_chunk(IM_HSV_COLORS);
+      }
+    }
+    if (bounded) {
+      spill_hsv.append(hsv);
+      decimated[SERIES_HUE].push(metric_table::hue_degrees(hsv[0]));
+      decimated[SERIES_SATURATION].push(metric_table::saturation_ratio(hsv[1]));
+      return;
+    }
+    metrics.hue.push_back(hsv[0]);
+    metrics.saturation.push_back(hsv[1]);
   }
 };
 
@@ -21,6 +21,11 @@
 #include <format.h>
 
 int image::create_img_dir() {
+  /* Everything goes to the image pack */
+  if (f->image_pack != NULL) {
+    return 0;
+  }
+
   /*
    * Stats open file
    */
@@ -62,16 +67,167 @@ int image::create_img_dir() {
   return 0;
 }
 
+/*
+ * Path of the image file relative to the output path, in directory "dir".
+ * Extra thumbnail renditions get their height as suffix.
+ */
+string image::file_name(const char *dir, int frame_number, int size) {
+  /* Pad numbers to constant string width: */
+  return fmt::format("{0}/{1}/{0}_{2:05}-{3:06}_{4}{5}.jpg", f->alphaid, dir,
+                     id, frame_number, this->type == BEGIN ? "in" : "out",
+                     size ? fmt::format("_{}", size) : string());
+}
+
+/*
+ * Name and size every thumbnail rendition. Returns their indexes from the
+ * largest to the smallest: the order of the downscale pyramid, where each
+ * level is made from the previous one.
+ */
+vector<size_t> image::plan_thumbs(int frame_number) {
+  const vector<int> &heights = f->thumb_heights;
+  vector<size_t> order;
+
+  thumbs.clear();
+  for (size_t i = 0; i < heights.size(); i++) {
+    rendition r;
+    r.height = heights[i];
+    r.width = max(1, (heights[i] * this->width) / this->height);
+    // The first size keeps the historical thumbnail name
+    r.src = file_name("thumbs", frame_number, i ? heights[i] : 0);
+    r.sheet = -1;
+    r.x = r.y = 0;
+    thumbs.push_back(r);
+    order.push_back(i);
+  }
+  sort(order.begin(), order.end(), [&heights](size_t a, size_t b) {
+    return heights[a] > heights[b];
+  });
+  return order;
+}
+
+/*
+ * Sprite sheet mode: record where rendition "index" was packed, and write
+ * the sheet once it is full
+ */
+void image::place_thumb(size_t index, const sprite::placement &p) {
+  sprite::sheet *sheet = f->thumb_sheets[index];
+  rendition &r = thumbs[index];
+  r.src = f->alphaid + "/sheets/" + sheet->file_name(p.sheet);
+  r.sheet = p.sheet;
+  r.x = p.x;
+  r.y = p.y;
+  r.width = p.width;
+  r.height = p.height;
+  if (sheet->full() && !sheet->flush()) store_failed(f, r.src);
+}
+
+/*
+ * Index entry of an image in the pack. A thumb_height of 0 is the shot
+ * image itself.
+ */
+pack::entry image::pack_entry(const string &name, int frame_number,
+                              int thumb_height) {
+  pack::entry e;
+  e.offset = 0;
+  e.length = 0;
+  e.frame = frame_number;
+  e.shot = id;
+  e.type = this->type == BEGIN ? pack::TYPE_IN : pack::TYPE_OUT;
+  e.kind = thumb_height ? pack::KIND_THUMB : pack::KIND_SHOT;
+  e.height = thumb_height ? thumb_height : height;
+  e.name = name;
+  return e;
+}
+
+void image::store_failed(const film *f, const string &name) {
+  cerr << (f->image_pack != NULL ? "pack: " : f->global_path + "/") << name
+       << endl;
+  perror("shotdetect ");
+  exit(EXIT_FAILURE);
+}
+
+/*
+ * Save a gd image as JPEG "name", in the pack or as a file
+ */
+void image::save_jpeg(gdImagePtr im, const string &name, int frame_number,
+                      int thumb_height) {
+  if (f->image_pack != NULL) {
+    int size = 0;
+    void *data = gdImageJpegPtr(im, &size, 90);
+    bool ok = data != NULL &&
+              f->image_pack->append(
+                  data, size, pack_entry(name, frame_number, thumb_height));
+    gdFree(data);
+    if (!ok) store_failed(f, name);
+    return;
+  }
+
+  FILE *jpgout;
+  string path = f->global_path + "/" + name;
+  if ((jpgout = fopen(path.c_str(), "wb")) == NULL) {
+    store_failed(f, name);
+  }
+  gdImageJpeg(im, jpgout, 90);
+  fclose(jpgout);
+}
+
+/*
+ * Encode a decoded frame as JPEG "name", in the pack or as a file
+ */
+void image::save_jpeg(jpeg::writer *writer, AVFrame *frame, int w, int h,
+                      const string &name, int frame_number, int thumb_height,
+                      AVFrame **encoded) {
+  bool ok;
+  if (f->image_pack != NULL) {
+    AVPacket packet;
+    ok = writer->encode(frame, w, h, &packet, encoded);
+    if (ok) {
+      ok = f->image_pack->append(packet.data, packet.size,
+                                 pack_entry(name, frame_number, thumb_height));
+      av_free_packet(&packet);
+    }
+  } else {
+    ok = writer->write(frame, w, h, f->global_path + "/" + name, encoded);
+  }
+  if (!ok) store_failed(f, name);
+}
+
+/*
+ * Encode the decoder's frame directly as JPEG, without an RGB copy or a gd
+ * image. Thumbnails are area downscales, each from the previous level.
+ */
+int image::SaveFrame(jpeg::writer *writer, AVFrame *pFrame, int frame_number) {
+  if (f->get_thumb()) {
+    vector<size_t> order = plan_thumbs(frame_number);
+    AVFrame *level = pFrame;
+    for (size_t i = 0; i < order.size(); i++) {
+      const rendition &r = thumbs[order[i]];
+      if (!f->thumb_sheets.empty()) {
+        AVFrame *scaled = writer->scale(level, r.width, r.height);
+        if (scaled == NULL) {
+          cerr << "Cannot scale thumbnail" << endl;
+          exit(EXIT_FAILURE);
+        }
+        level = scaled;
+        place_thumb(order[i], f->thumb_sheets[order[i]]->add(level));
+        continue;
+      }
+      save_jpeg(writer, level, r.width, r.height, r.src, frame_number,
+                r.height, &level);
+    }
+  }
+
+  if (f->get_shot()) {
+    img = file_name("shots", frame_number);
+    save_jpeg(writer, pFrame, width, height, img, frame_number, 0);
+  }
+
+  return 0;
+}
+
 int image::SaveFrame(AVFrame *pFrame, int frame_number) {
   // TODO Takes a long time. Better idea is to push the raw data in a queue and process it in another thread.
-  // c->thumb_height set to 84
-  // FIXME this->height_thumb and width_thumb are set but not used.
-  int width_s = (THUMB_HEIGHT * this->width) / this->height;
-  int height_s = THUMB_HEIGHT;
-  FILE *jpgout;
-  FILE *minijpgout;
   int y, x;
-  ostringstream str;
 
   /*
    * Pointer to images
@@ -87,14 +243,6 @@ int image::SaveFrame(AVFrame *pFrame, int frame_number) {
     exit(EXIT_FAILURE);
   }
 
-  /*
-   * Creating mini image
-   */
-  if ((void *)(miniim = gdImageCreateTrueColor(width_s, height_s)) == NULL) {
-    cerr << "Problem Creating True color IMG" << endl;
-    exit(EXIT_FAILURE);
-  }
-
   for (y = 0; y < height; y++) {
     for (x = 0; x < width; x++) {
       /*
@@ -112,64 +260,45 @@ int image::SaveFrame(AVFrame *pFrame, int frame_number) {
     }
   }
 
-  /* Pad numbers to constant string width: */
-  std::string s_id = fmt::format("{:05}",id);
-  std::string s_frame_number = fmt::format("{:06}", frame_number);
-
-  /* Creating file and saving it */
+  /* Creating files and saving them, largest thumbnail first */
   if (f->get_thumb()) {
-    /* Name of image file */
-    str.str("");
-    if (this->type == BEGIN){
-      str << f->alphaid << "/thumbs/" << f->alphaid << "_" << s_id << "-"
-          << s_frame_number << "_in.jpg";
-    } else {
-      str << f->alphaid << "/thumbs/" << f->alphaid << "_" << s_id << "-"
-          << s_frame_number << "_out.jpg";
-    }
+    vector<size_t> order = plan_thumbs(frame_number);
+    gdImagePtr level = im;
+    for (size_t i = 0; i < order.size(); i++) {
+      const rendition &r = thumbs[order[i]];
 
-    thumb = str.str();
-    str.str("");
-    str << f->global_path << "/" << thumb;
-
-    /* Prepare file */
-    if ((minijpgout = fopen(str.str().c_str(), "wb")) == NULL) {
-      cerr << str.str() << endl;
-      perror("shotdetect ");
-      exit(EXIT_FAILURE);
+      /*
+       * Creating mini image from the previous, larger level
+       */
+      if ((void *)(miniim = gdImageCreateTrueColor(r.width, r.height)) ==
+          NULL) {
+        cerr << "Problem Creating True color IMG" << endl;
+        exit(EXIT_FAILURE);
+      }
+      gdImageCopyResized(miniim, level, 0, 0, 0, 0, r.width, r.height,
+                         level->sx, level->sy);
+      if (level != im) {
+        gdImageDestroy(level);
+      }
+      level = miniim;
+      if (!f->thumb_sheets.empty()) {
+        place_thumb(order[i], f->thumb_sheets[order[i]]->add(miniim));
+        continue;
+      }
+      save_jpeg(miniim, r.src, frame_number, r.height);
+    }
+    if (level != im) {
+      gdImageDestroy(level);
     }
-    gdImageCopyResized(miniim, im, 0, 0, 0, 0, width_s, height_s, width,
-                       height);
-    gdImageJpeg(miniim, minijpgout, 90);
-    fclose(minijpgout);
   }
 
   if (f->get_shot()) {
     /* Name of image file */
-    str.str("");
-    if (this->type == BEGIN)
-      str << f->alphaid << "/shots/" << f->alphaid << "_" << s_id << "-"
-          << s_frame_number << "_in.jpg";
-    else
-      str << f->alphaid << "/shots/" << f->alphaid << "_" << s_id << "-"
-          << s_frame_number << "_out.jpg";
-
-    img = str.str();
-    str.str("");
-    str << f->global_path << "/" << img;
-
-    /* Prepare file */
-    if ((jpgout = fopen(str.str().c_str(), "wb")) == NULL) {
-      cerr << str.str() << endl;
-      perror("shotdetect ");
-      exit(EXIT_FAILURE);
-    }
-    gdImageJpeg(im, jpgout, 90);
-    fclose(jpgout);
+    img = file_name("shots", frame_number);
+    save_jpeg(im, img, frame_number, 0);
   }
 
   gdImageDestroy(im);
-  gdImageDestroy(miniim);
 
   return 0;
 }
@@ -182,7 +311,4 @@ image::image(film *_f, int _width, int _height, int _id, bool _type,
       f(_f),
       id(_id),
       height(_height),
-      width(_width) {
-  this->height_thumb = 150;
-  this->width_thumb = int(double(150 * width) / double(height));
-}
+      width(_width) {}
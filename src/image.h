@@ -21,6 +21,8 @@ extern "C" {
 
 #include <string.h>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <stdlib.h>
 
 #include <sys/types.h>
@@ -28,6 +30,9 @@ extern "C" {
 #include <unistd.h>
 
 #include <film.h>
+#include <jpeg.h>
+#include <pack.h>
+#include <sprite.h>
 
 #include <gd.h>
 #ifdef WXWIDGETS
@@ -46,16 +51,38 @@ class image {
   bool thumb_set;
   bool shot_set;
 
+  string file_name(const char *dir, int frame_number, int size = 0);
+  vector<size_t> plan_thumbs(int frame_number);
+  void place_thumb(size_t index, const sprite::placement &p);
+  pack::entry pack_entry(const string &name, int frame_number,
+                         int thumb_height);
+  void save_jpeg(gdImagePtr im, const string &name, int frame_number,
+                 int thumb_height);
+  void save_jpeg(jpeg::writer *writer, AVFrame *frame, int w, int h,
+                 const string &name, int frame_number, int thumb_height,
+                 AVFrame **encoded = NULL);
+
  public:
   int width;
   int height;
-  int width_thumb;
-  int height_thumb;
-  string thumb;
+  /* Thumbnail renditions, in the order of film::thumb_heights */
+  struct rendition {
+    string src;
+    int width;
+    int height;
+    int sheet;  // sprite sheet number, -1 for a file of its own
+    int x, y;   // position in the sheet
+  };
+  vector<rendition> thumbs;
   string img;
   int id;
   bool type;  // BEGIN || END
+  /* Report an image that could not be stored and exit */
+  static void store_failed(const film *f, const string &name);
+  inline bool get_thumb_set() const { return thumb_set; }
+  inline bool get_shot_set() const { return shot_set; }
   int SaveFrame(AVFrame *pFrame, int frame_number);
+  int SaveFrame(jpeg::writer *writer, AVFrame *pFrame, int frame_number);
   int create_img_dir();
   image(film *, int, int, int, bool, bool, bool);
 };
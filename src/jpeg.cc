@@ -0,0 +1,163 @@
+#include <jpeg.h>
+
+#include <stdio.h>
+
+namespace jpeg {
+
+/*
+ * Frames the MJPEG encoder takes as they are: full range YUV only, as
+ * limited range JPEGs show washed out in ordinary decoders. Anything else
+ * is converted to YUVJ420P, like the thumbnails.
+ */
+static bool encodable(AVPixelFormat format, AVColorRange range) {
+    switch (format) {
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_YUVJ422P:
+        case AV_PIX_FMT_YUVJ444P:
+            return true;
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUV444P:
+            return range == AVCOL_RANGE_JPEG;
+        default:
+            return false;
+    }
+}
+
+writer::writer(int qscale, convert::cache *conversions)
+    : qscale(qscale), conversions(conversions) {
+    if (conversions == NULL) {
+        own_conversions.reset(new convert::cache());
+        this->conversions = own_conversions.get();
+    }
+}
+
+writer::~writer() {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        avcodec_free_context(&outputs[i].ctx);
+    }
+}
+
+writer::output *writer::get_output(AVFrame *frame, int width, int height) {
+    const AVPixelFormat src_format = AVPixelFormat(frame->format);
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (outputs[i].width == width && outputs[i].height == height &&
+            outputs[i].src_width == frame->width &&
+            outputs[i].src_height == frame->height &&
+            outputs[i].src_format == src_format &&
+            outputs[i].src_range == frame->color_range) {
+            return &outputs[i];
+        }
+    }
+
+    output out;
+    out.width = width;
+    out.height = height;
+    out.src_width = frame->width;
+    out.src_height = frame->height;
+    out.src_format = src_format;
+    out.src_range = frame->color_range;
+    out.direct = encodable(src_format, frame->color_range) &&
+                 width == frame->width && height == frame->height;
+    out.ctx = NULL;
+    outputs.push_back(out);
+    return &outputs.back();
+}
+
+/*
+ * Open the encoder of an output on its first use
+ */
+bool writer::open_encoder(output *out, AVFrame *src) {
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    out->ctx = codec ? avcodec_alloc_context3(codec) : NULL;
+    if (out->ctx == NULL) {
+        return false;
+    }
+    out->ctx->width = out->width;
+    out->ctx->height = out->height;
+    out->ctx->pix_fmt = AVPixelFormat(src->format);
+    out->ctx->time_base.num = 1;
+    out->ctx->time_base.den = 25;
+    out->ctx->color_range = AVCOL_RANGE_JPEG;
+    out->ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    out->ctx->global_quality = FF_QP2LAMBDA * qscale;
+    out->ctx->qmin = out->ctx->qmax = qscale;
+    if (avcodec_open2(out->ctx, codec, NULL) < 0) {
+        avcodec_free_context(&out->ctx);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Convert and scale "frame" to width x height as it would be encoded,
+ * without encoding it. Returns the frame itself when nothing is to do.
+ */
+AVFrame *writer::scale(AVFrame *frame, int width, int height) {
+    output *out = get_output(frame, width, height);
+    if (out->direct) {
+        return frame;
+    }
+    // Without a shared cache, nothing tells when the source is a new picture
+    if (own_conversions) {
+        own_conversions->next_frame();
+    }
+    return conversions->get(frame, AV_PIX_FMT_YUVJ420P, width, height,
+                            SWS_AREA);
+}
+
+/*
+ * Encode "frame" at width x height into "packet", to be released with
+ * av_free_packet(). The frame that was actually encoded is returned in
+ * "encoded"; it stays valid until the next encode at the same size and can
+ * be the source of a smaller one.
+ */
+bool writer::encode(AVFrame *frame, int width, int height, AVPacket *packet,
+                    AVFrame **encoded) {
+    av_init_packet(packet);
+    packet->data = NULL;
+    packet->size = 0;
+
+    AVFrame *src = scale(frame, width, height);
+    if (src == NULL) {
+        return false;
+    }
+    output *out = get_output(frame, width, height);
+    if (out->ctx == NULL && !open_encoder(out, src)) {
+        return false;
+    }
+    src->quality = out->ctx->global_quality;
+    if (encoded != NULL) {
+        *encoded = src;
+    }
+
+    int got_packet = 0;
+    if (avcodec_encode_video2(out->ctx, packet, src, &got_packet) < 0 ||
+        !got_packet) {
+        av_free_packet(packet);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Encode "frame" at width x height into the JPEG file "path"
+ */
+bool writer::write(AVFrame *frame, int width, int height,
+                   std::string const &path, AVFrame **encoded) {
+    AVPacket packet;
+    if (!encode(frame, width, height, &packet, encoded)) {
+        return false;
+    }
+
+    FILE *fd = fopen(path.c_str(), "wb");
+    bool ok = fd != NULL && fwrite(packet.data, 1, packet.size, fd) ==
+                                size_t(packet.size);
+    if (fd != NULL && fclose(fd) != 0) {
+        ok = false;
+    }
+    av_free_packet(&packet);
+    return ok;
+}
+
+}
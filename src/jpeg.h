@@ -0,0 +1,58 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <convert.h>
+
+extern "C" {
+#   include <libavcodec/avcodec.h>
+#   include <libswscale/swscale.h>
+}
+
+namespace jpeg
+{
+
+/*
+ * Writes decoded video frames as JPEG files with libavcodec's MJPEG
+ * encoder, straight from the decoder's YUV planes. Frames are only
+ * converted when the encoder cannot take the decoder's pixel format, and
+ * only scaled (area averaging) when a smaller size is asked for, through
+ * the given conversion cache or one of the writer's own. One encoder is
+ * kept per source and output size and pixel format.
+ */
+class writer {
+public:
+    explicit writer(int qscale = 2, convert::cache *conversions = NULL);
+    ~writer();
+
+    bool encode(AVFrame *frame, int width, int height, AVPacket *packet,
+                AVFrame **encoded = NULL);
+    bool write(AVFrame *frame, int width, int height, std::string const &path,
+               AVFrame **encoded = NULL);
+    AVFrame *scale(AVFrame *frame, int width, int height);
+
+private:
+    struct output {
+        int width, height;
+        int src_width, src_height;
+        AVPixelFormat src_format;
+        AVColorRange src_range;
+        bool direct;  // encoded as it is, without conversion
+        AVCodecContext *ctx;
+    };
+
+    output *get_output(AVFrame *frame, int width, int height);
+    bool open_encoder(output *out, AVFrame *src);
+
+    int qscale;
+    std::vector<output> outputs;
+    std::unique_ptr<convert::cache> own_conversions;
+    convert::cache *conversions;
+};
+
+}
+
+#endif // JPEG_H
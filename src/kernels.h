@@ -0,0 +1,254 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+extern "C" {
+#   include <libavutil/avutil.h>
+}
+
+namespace kernels
+{
+
+/*
+ * Per-frame features a scan can compute, as a bit mask
+ */
+enum feature {
+    SAD = 1,        // sum of absolute differences with the previous frame
+    AVERAGES = 2,   // mean of each colour channel
+    TILES = 4,      // the same sum split over a grid of tiles
+    HISTOGRAM = 8,  // 8x8x8 colour histogram
+    ALL = 15,       // every feature scan() reads from an RGB frame
+    PLANES = 16     // SAD of the decoded YUV planes, see planar_sad()
+};
+
+/*
+ * Packed 8-bit RGB layouts: bytes per pixel and offset of each channel
+ */
+template <int Step, int R, int G, int B>
+struct packed_rgb {
+    static const int step = Step, r = R, g = G, b = B;
+};
+
+template <AVPixelFormat Fmt> struct layout;
+template <> struct layout<AV_PIX_FMT_RGB24>: packed_rgb<3, 0, 1, 2> {};
+template <> struct layout<AV_PIX_FMT_BGR24>: packed_rgb<3, 2, 1, 0> {};
+template <> struct layout<AV_PIX_FMT_RGBA>: packed_rgb<4, 0, 1, 2> {};
+template <> struct layout<AV_PIX_FMT_BGRA>: packed_rgb<4, 2, 1, 0> {};
+
+static const int HIST_BINS = 512;
+
+/*
+ * Raw sums of one scan. "cols" x "rows" is set by the caller: the tile
+ * grid, or only bands for the threads when TILES is not asked for.
+ */
+struct sums {
+    int cols, rows;
+    uint64_t abs_diff;
+    uint64_t c1, c2, c3;
+    std::vector<uint64_t> tiles;
+    uint32_t bins[HIST_BINS];
+};
+
+inline int hist_bin(uint8_t r, uint8_t g, uint8_t b) {
+    return ((r >> 5) << 6) | ((g >> 5) << 3) | (b >> 5);
+}
+
+/*
+ * Every feature of "Features" in one pass over the pixels. Each thread
+ * takes whole rows of tiles; along a pixel row the sum of one tile's strip
+ * stays in a register, and the histogram is counted into 4 interleaved
+ * sub-histograms so runs of pixels in the same bin do not wait on each
+ * other. Feature tests are on the template argument: the inner loop of
+ * each specialization has no branch left.
+ */
+template <typename Layout, unsigned Features>
+void scan(uint8_t const *cur, int cur_stride, uint8_t const *prev,
+          int prev_stride, int width, int height, sums &out) {
+    const bool diff = (Features & (SAD | TILES)) != 0;
+    const int LANES = 4;
+    const int cols = std::max(1, std::min(out.cols, width));
+    const int rows = std::max(1, std::min(out.rows, height));
+
+    std::vector<int> x_edges(cols + 1);
+    for (int tx = 0; tx <= cols; tx++) {
+        x_edges[tx] = tx * width / cols;
+    }
+    out.cols = cols;
+    out.rows = rows;
+    out.tiles.assign(cols * rows, 0);
+    std::fill(out.bins, out.bins + HIST_BINS, 0);
+
+    uint64_t c1tot = 0;
+    uint64_t c2tot = 0;
+    uint64_t c3tot = 0;
+
+    #pragma omp parallel reduction(+:c1tot,c2tot,c3tot)
+    {
+        uint32_t lanes[LANES][HIST_BINS];
+        if (Features & HISTOGRAM) {
+            std::fill(&lanes[0][0], &lanes[0][0] + LANES * HIST_BINS, 0);
+        }
+
+        #pragma omp for
+        for (int ty = 0; ty < rows; ty++) {
+            uint64_t *row_sums = &out.tiles[ty * cols];
+            for (int y = ty * height / rows; y < (ty + 1) * height / rows; y++) {
+                uint8_t const *c = cur + y * cur_stride;
+                uint8_t const *p = diff ? prev + y * prev_stride : NULL;
+                unsigned int s1 = 0, s2 = 0, s3 = 0;
+                for (int tx = 0; tx < cols; tx++) {
+                    unsigned int strip = 0;
+                    for (int x = x_edges[tx]; x < x_edges[tx + 1]; x++) {
+                        uint8_t const *px = c + x * Layout::step;
+                        if (diff) {
+                            uint8_t const *pp = p + x * Layout::step;
+                            strip += abs(px[0] - pp[0]) + abs(px[1] - pp[1]) +
+                                     abs(px[2] - pp[2]);
+                        }
+                        if (Features & AVERAGES) {
+                            s1 += px[Layout::r];
+                            s2 += px[Layout::g];
+                            s3 += px[Layout::b];
+                        }
+                        if (Features & HISTOGRAM) {
+                            lanes[x & (LANES - 1)][hist_bin(px[Layout::r], px[Layout::g], px[Layout::b])]++;
+                        }
+                    }
+                    if (diff) row_sums[tx] += strip;
+                }
+                c1tot += s1;
+                c2tot += s2;
+                c3tot += s3;
+            }
+        }
+
+        if (Features & HISTOGRAM) {
+            #pragma omp critical
+            for (int b = 0; b < HIST_BINS; b++) {
+                out.bins[b] += lanes[0][b] + lanes[1][b] + lanes[2][b] + lanes[3][b];
+            }
+        }
+    }
+
+    out.abs_diff = 0;
+    for (size_t i = 0; i < out.tiles.size(); i++) {
+        out.abs_diff += out.tiles[i];
+    }
+    out.c1 = c1tot;
+    out.c2 = c2tot;
+    out.c3 = c3tot;
+}
+
+typedef void (*scan_fn)(uint8_t const *, int, uint8_t const *, int, int, int, sums &);
+
+template <typename Layout>
+inline scan_fn pick(unsigned features) {
+    static const scan_fn table[ALL + 1] = {
+        &scan<Layout, 0>,  &scan<Layout, 1>,  &scan<Layout, 2>,  &scan<Layout, 3>,
+        &scan<Layout, 4>,  &scan<Layout, 5>,  &scan<Layout, 6>,  &scan<Layout, 7>,
+        &scan<Layout, 8>,  &scan<Layout, 9>,  &scan<Layout, 10>, &scan<Layout, 11>,
+        &scan<Layout, 12>, &scan<Layout, 13>, &scan<Layout, 14>, &scan<Layout, 15>};
+    return table[features & ALL];
+}
+
+/*
+ * The specialization for a pixel format and a feature mask, chosen once
+ * per frame; NULL for an unsupported pixel format
+ */
+inline scan_fn select(AVPixelFormat fmt, unsigned features) {
+    switch (fmt) {
+    case AV_PIX_FMT_RGB24: return pick<layout<AV_PIX_FMT_RGB24> >(features);
+    case AV_PIX_FMT_BGR24: return pick<layout<AV_PIX_FMT_BGR24> >(features);
+    case AV_PIX_FMT_RGBA: return pick<layout<AV_PIX_FMT_RGBA> >(features);
+    case AV_PIX_FMT_BGRA: return pick<layout<AV_PIX_FMT_BGRA> >(features);
+    default: return NULL;
+    }
+}
+
+/*
+ * Sum of absolute differences of two rows of samples
+ */
+template <typename Sample>
+inline uint64_t row_sad(Sample const *a, Sample const *b, int n) {
+    uint64_t sum = 0;
+    for (int x = 0; x < n; x++) {
+        sum += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+    }
+    return sum;
+}
+
+#ifdef __SSE2__
+/*
+ * 16-bit samples, 8 at a time: |a - b| is the OR of the two saturated
+ * differences (psubusw), and pmaddwd against 1 adds pairs of them into
+ * 32-bit lanes. Samples of at most 15 bits stay positive as int16.
+ */
+template <>
+inline uint64_t row_sad<uint16_t>(uint16_t const *a, uint16_t const *b, int n) {
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i acc = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + x));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + x));
+        const __m128i d = _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(d, ones));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    uint64_t sum = uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    for (; x < n; x++) {
+        sum += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+    }
+    return sum;
+}
+
+/* 8-bit samples, 16 at a time with psadbw */
+template <>
+inline uint64_t row_sad<uint8_t>(uint8_t const *a, uint8_t const *b, int n) {
+    __m128i acc = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + x));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + x));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    uint64_t halves[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(halves), acc);
+    uint64_t sum = halves[0] + halves[1];
+    for (; x < n; x++) {
+        sum += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+    }
+    return sum;
+}
+#endif
+
+/*
+ * Sum of absolute differences of one plane of "Bits"-bit samples, in
+ * units of the least significant bit
+ */
+template <typename Sample, int Bits>
+uint64_t planar_sad(uint8_t const *a, int a_stride, uint8_t const *b,
+                    int b_stride, int width, int height) {
+    static_assert(Bits <= 8 * int(sizeof(Sample)), "samples too narrow");
+    static_assert(sizeof(Sample) == 1 || Bits <= 15, "samples too wide for pmaddwd");
+    uint64_t sum = 0;
+    #pragma omp parallel for reduction(+:sum)
+    for (int y = 0; y < height; y++) {
+        sum += row_sad(reinterpret_cast<Sample const *>(a + y * a_stride),
+                       reinterpret_cast<Sample const *>(b + y * b_stride), width);
+    }
+    return sum;
+}
+
+}
+
+#endif // KERNELS_H
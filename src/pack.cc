@@ -0,0 +1,185 @@
+#include <pack.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pack {
+
+static char const MAGIC[4] = {'S', 'D', 'P', 'K'};
+static uint32_t const VERSION = 1;
+static size_t const HEADER_SIZE = 8;
+static size_t const TRAILER_SIZE = 16;
+static size_t const RECORD_SIZE = 26;  // index record without the name
+
+template <typename T>
+static void put(std::vector<uint8_t> &out, T v) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out.push_back(uint8_t(uint64_t(v) >> (8 * i)));
+    }
+}
+
+template <typename T>
+static T get(uint8_t const *p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        v |= uint64_t(p[i]) << (8 * i);
+    }
+    return T(v);
+}
+
+writer::writer(): fd(NULL), offset(0), failed(false) {}
+
+writer::~writer() {
+    close();
+}
+
+bool writer::open(std::string const &path) {
+    close();
+    fd = fopen(path.c_str(), "wb");
+    if (fd == NULL) {
+        return false;
+    }
+    // Few large sequential writes, whatever the image sizes
+    buffer.resize(4 << 20);
+    setvbuf(fd, &buffer[0], _IOFBF, buffer.size());
+
+    std::vector<uint8_t> header(MAGIC, MAGIC + 4);
+    put<uint32_t>(header, VERSION);
+    failed = fwrite(&header[0], 1, header.size(), fd) != header.size();
+    offset = header.size();
+    index.clear();
+    return !failed;
+}
+
+bool writer::append(void const *data, size_t size, entry const &meta) {
+    if (fd == NULL || failed) {
+        return false;
+    }
+    if (fwrite(data, 1, size, fd) != size) {
+        failed = true;
+        return false;
+    }
+    entry e = meta;
+    e.offset = offset;
+    e.length = uint32_t(size);
+    index.push_back(e);
+    offset += size;
+    return true;
+}
+
+bool writer::close() {
+    if (fd == NULL) {
+        return true;
+    }
+
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i < index.size(); i++) {
+        entry const &e = index[i];
+        put<uint64_t>(out, e.offset);
+        put<uint32_t>(out, e.length);
+        put<int32_t>(out, e.frame);
+        put<int32_t>(out, e.shot);
+        put<uint8_t>(out, e.type);
+        put<uint8_t>(out, e.kind);
+        put<uint16_t>(out, e.height);
+        put<uint16_t>(out, uint16_t(e.name.size()));
+        out.insert(out.end(), e.name.begin(), e.name.end());
+    }
+    put<uint64_t>(out, offset);
+    put<uint32_t>(out, uint32_t(index.size()));
+    out.insert(out.end(), MAGIC, MAGIC + 4);
+
+    bool ok = !failed && fwrite(&out[0], 1, out.size(), fd) == out.size();
+    ok = fclose(fd) == 0 && ok;
+    fd = NULL;
+    std::vector<char>().swap(buffer);
+    index.clear();
+    return ok;
+}
+
+reader::reader(): base(NULL), size(0) {}
+
+reader::~reader() {
+    close();
+}
+
+bool reader::open(std::string const &path) {
+    close();
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(file, &st) != 0 || size_t(st.st_size) < HEADER_SIZE + TRAILER_SIZE) {
+        ::close(file);
+        return false;
+    }
+    size = size_t(st.st_size);
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if (map == MAP_FAILED) {
+        size = 0;
+        return false;
+    }
+    base = static_cast<uint8_t const *>(map);
+
+    uint8_t const *trailer = base + size - TRAILER_SIZE;
+    const uint64_t index_offset = get<uint64_t>(trailer);
+    const uint32_t count = get<uint32_t>(trailer + 8);
+    if (memcmp(base, MAGIC, 4) != 0 || memcmp(trailer + 12, MAGIC, 4) != 0 ||
+        get<uint32_t>(base + 4) != VERSION ||
+        index_offset > size - TRAILER_SIZE) {
+        close();
+        return false;
+    }
+
+    uint8_t const *p = base + index_offset;
+    for (uint32_t i = 0; i < count; i++) {
+        if (p + RECORD_SIZE > trailer) {
+            close();
+            return false;
+        }
+        entry e;
+        e.offset = get<uint64_t>(p);
+        e.length = get<uint32_t>(p + 8);
+        e.frame = get<int32_t>(p + 12);
+        e.shot = get<int32_t>(p + 16);
+        e.type = p[20];
+        e.kind = p[21];
+        e.height = get<uint16_t>(p + 22);
+        const uint16_t name_length = get<uint16_t>(p + 24);
+        p += RECORD_SIZE;
+        if (p + name_length > trailer ||
+            e.offset + e.length > index_offset) {
+            close();
+            return false;
+        }
+        e.name.assign(reinterpret_cast<char const *>(p), name_length);
+        p += name_length;
+        index.push_back(e);
+    }
+    return true;
+}
+
+void reader::close() {
+    if (base != NULL) {
+        munmap(const_cast<uint8_t *>(base), size);
+    }
+    base = NULL;
+    size = 0;
+    index.clear();
+}
+
+entry const *reader::find(std::string const &name) const {
+    for (size_t i = 0; i < index.size(); i++) {
+        if (index[i].name == name) {
+            return &index[i];
+        }
+    }
+    return NULL;
+}
+
+}
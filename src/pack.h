@@ -0,0 +1,85 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace pack
+{
+
+/*
+ * Single-file image archive:
+ *
+ *   "SDPK" version(u32)
+ *   image data, back to back
+ *   index: one record per image
+ *     offset(u64) length(u32) frame(i32) shot(i32) type(u8) kind(u8)
+ *     height(u16) name_length(u16) name
+ *   trailer: index_offset(u64) count(u32) "SDPK"
+ *
+ * All integers are little endian. The trailer is at a fixed distance from
+ * the end, so a reader finds the index with a single seek (or mmap).
+ */
+enum image_type { TYPE_IN = 0, TYPE_OUT = 1 };
+enum image_kind { KIND_SHOT = 0, KIND_THUMB = 1, KIND_SHEET = 2 };
+
+struct entry {
+    uint64_t offset;
+    uint32_t length;
+    int32_t frame;
+    int32_t shot;
+    uint8_t type;
+    uint8_t kind;
+    uint16_t height;
+    std::string name;
+};
+
+/*
+ * Append-only pack writer. Images go out through one large stdio buffer;
+ * the index is kept in memory and written by close().
+ */
+class writer {
+public:
+    writer();
+    ~writer();
+
+    bool open(std::string const &path);
+    bool append(void const *data, size_t size, entry const &meta);
+    bool close();
+
+    inline bool is_open() const { return fd != NULL; }
+
+private:
+    FILE *fd;
+    uint64_t offset;
+    bool failed;
+    std::vector<entry> index;
+    std::vector<char> buffer;
+};
+
+/*
+ * Read-only access to a pack through mmap
+ */
+class reader {
+public:
+    reader();
+    ~reader();
+
+    bool open(std::string const &path);
+    void close();
+
+    inline std::vector<entry> const &entries() const { return index; }
+    entry const *find(std::string const &name) const;
+    inline uint8_t const *data(entry const &e) const { return base + e.offset; }
+
+private:
+    uint8_t const *base;
+    size_t size;
+    std::vector<entry> index;
+};
+
+}
+
+#endif // PACK_H
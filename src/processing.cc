@@ -1,7 +1,25 @@
 #include <processing.h>
+#include <kernels.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <array>
 
 namespace processing {
 
+static void check_dimensions(AVFrame const *pFrame, AVFrame const *pFramePrev) {
+    if( (pFrame->width==0) || (pFramePrev->width==0) ||
+        (pFrame->height==0) || (pFramePrev->height==0)
+            ){
+        throw FrameDimensionsNotSet();
+    }
+    if ( (pFrame->width != pFramePrev->width) ||
+         (pFrame->height != pFramePrev->height) ) {
+        throw FrameDimensionsDiffer();
+    }
+}
+
 YUVTriple get_yuv_colors(AVFrame const &frame) {
     auto const width = frame.width;
     auto const height = frame.height;
@@ -30,72 +48,339 @@ YUVTriple get_yuv_colors(AVFrame const &frame) {
     return {y_avg, cb_avg, cr_avg};
 }
 
-FrameDiff abs_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, bool compute_averages){
+/*
+ * Averages, tiles and histogram of a scan, as far as "features" asked for
+ */
+FrameFeatures scan_frame(AVFrame const *pFrame, AVFrame const *pFramePrev, unsigned features, int cols, int rows){
 
-    if( (pFrame->width==0) || (pFramePrev->width==0) ||
-        (pFrame->height==0) || (pFramePrev->height==0)
-            ){
+    if ((pFrame->width == 0) || (pFrame->height == 0)) {
         throw FrameDimensionsNotSet();
     }
-    if ( (pFrame->width != pFramePrev->width) ||
-         (pFrame->height != pFramePrev->height) ) {
-        throw FrameDimensionsDiffer();
+    if (features & (kernels::SAD | kernels::TILES)) {
+        check_dimensions(pFrame, pFramePrev);
+    }
+    // Without tiles the grid only splits the rows between the threads
+    if (!(features & kernels::TILES)) {
+        cols = 1;
+        rows = 64;
     }
 
-    auto width = pFrame->width;
-    auto height = pFrame->height;
+    auto const width = pFrame->width;
+    auto const height = pFrame->height;
+    kernels::sums sums;
+    sums.cols = cols;
+    sums.rows = rows;
+    kernels::select(AV_PIX_FMT_RGB24, features)(
+        pFrame->data[0], pFrame->linesize[0],
+        pFramePrev != NULL ? pFramePrev->data[0] : NULL,
+        pFramePrev != NULL ? pFramePrev->linesize[0] : 0,
+        width, height, sums);
 
-    int c1tot = 0;
-    int c2tot = 0;
-    int c3tot = 0;
-    unsigned int abs_diff = 0;
+    const unsigned int nbpx = (height * width);
+    FrameFeatures result;
+    result.mask = features;
+    result.diff.abs_diff = sums.abs_diff;
+    result.diff.abs_norm_diff = static_cast<double>(sums.abs_diff) / nbpx;
+    result.diff.nb_pix = nbpx;
+    if (features & kernels::AVERAGES){
+        result.diff.c1avg = static_cast<double>(sums.c1) / nbpx;
+        result.diff.c2avg = static_cast<double>(sums.c2) / nbpx;
+        result.diff.c3avg = static_cast<double>(sums.c3) / nbpx;
+    }else{
+        result.diff.c1avg = result.diff.c2avg = result.diff.c3avg = 0;
+    }
+
+    result.tiles.global = result.diff;
+    result.tiles.cols = sums.cols;
+    result.tiles.rows = sums.rows;
+    if (features & kernels::TILES) {
+        result.tiles.tiles.resize(sums.tiles.size());
+        for (int ty = 0; ty < sums.rows; ty++) {
+            const int tile_height = (ty + 1) * height / sums.rows - ty * height / sums.rows;
+            for (int tx = 0; tx < sums.cols; tx++) {
+                const int tile_width = (tx + 1) * width / sums.cols - tx * width / sums.cols;
+                result.tiles.tiles[ty * sums.cols + tx] =
+                    static_cast<double>(sums.tiles[ty * sums.cols + tx]) / (tile_width * tile_height);
+            }
+        }
+    }
 
-    // IDEA! Split image in slices and calculate score per-slice.
-    // This would allow to detect areas on the image which have stayed
-    // the same, and (a) increase score if all areas have changed
-    // and (b) decrease score if some areas have changed less (ot not at all).
+    std::copy(sums.bins, sums.bins + Histogram::BINS, result.hist.bins);
+    result.hist.nb_pix = nbpx;
+    result.hist.c1avg = result.diff.c1avg;
+    result.hist.c2avg = result.diff.c2avg;
+    result.hist.c3avg = result.diff.c3avg;
+    return result;
+}
 
-    #pragma omp parallel for reduction(+:c1tot,c2tot,c3tot,abs_diff)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            const auto c1 = *(pFrame->data[0] + y * pFrame->linesize[0] + x * 3);
-            const auto c2 = *(pFrame->data[0] + y * pFrame->linesize[0] + x * 3 + 1);
-            const auto c3 = *(pFrame->data[0] + y * pFrame->linesize[0] + x * 3 + 2);
+/*
+ * Stratified sample of the rows: the frame is cut into bands of "stratum"
+ * rows, and two rows of each band are compared whole, so the reads stay
+ * sequential. The rows are an odd number of lines apart, one from each
+ * field, so a cut in one field of an interlaced frame is seen. The two
+ * rows of a band give its variance; the bound is 4 standard errors of the
+ * weighted mean, plus the whole spread of any band whose rows disagree by
+ * more than a factor of 2, where the rows in between may hold anything.
+ * Bands of 2 rows or less are read entirely.
+ */
+DiffEstimate sampled_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, int stratum){
 
-            const auto c1prev = *(pFramePrev->data[0] + y * pFramePrev->linesize[0] + x * 3);
-            const auto c2prev = *(pFramePrev->data[0] + y * pFramePrev->linesize[0] + x * 3 + 1);
-            const auto c3prev = *(pFramePrev->data[0] + y * pFramePrev->linesize[0] + x * 3 + 2);
+    check_dimensions(pFrame, pFramePrev);
 
-            if(compute_averages){
-                c1tot += c1;
-                c2tot += c2;
-                c3tot += c3;
-            }
+    auto const width = pFrame->width;
+    auto const height = pFrame->height;
+    stratum = std::max(stratum, 4);
+    const int bands = (height + stratum - 1) / stratum;
+
+    double mean = 0;
+    double variance = 0;
+    double spread = 0;
 
-            abs_diff += abs(c1 - c1prev) + abs(c2 - c2prev) + abs(c3 - c3prev);
+    #pragma omp parallel for reduction(+:mean,variance,spread)
+    for (int k = 0; k < bands; k++) {
+        const int first = k * stratum;
+        const int rows = std::min(stratum, height - first);
+        const double weight = static_cast<double>(rows) / height;
+        auto const row = [&](int y) {
+            return static_cast<double>(kernels::row_sad(
+                       pFrame->data[0] + y * pFrame->linesize[0],
+                       pFramePrev->data[0] + y * pFramePrev->linesize[0],
+                       3 * width)) / width;
+        };
+        if (rows <= 2) {
+            double sum = 0;
+            for (int y = first; y < first + rows; y++) sum += row(y);
+            mean += weight * sum / rows;
+            continue;
+        }
+        int gap = rows / 2;
+        if (gap % 2 == 0) gap--;
+        const double r0 = row(first + rows / 4);
+        const double r1 = row(first + rows / 4 + gap);
+        const double s2 = (r0 - r1) * (r0 - r1) / 2;
+        mean += weight * (r0 + r1) / 2;
+        variance += weight * weight * s2 / 2 * (1 - 2.0 / rows);
+        if (std::min(r0, r1) < std::max(r0, r1) / 2) {
+            spread += weight * fabs(r0 - r1);
         }
     }
 
-    const unsigned int nbpx = (height * width);
-    const double abs_norm_diff = static_cast<double>(abs_diff) / nbpx;
+    DiffEstimate result;
+    result.mean = mean;
+    result.bound = 4 * sqrt(variance) + spread;
+    return result;
+}
+
+FrameDiff abs_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, bool compute_averages){
+    return scan_frame(pFrame, pFramePrev, kernels::SAD | (compute_averages ? kernels::AVERAGES : 0)).diff;
+}
+
+unsigned int TileDiff::changed(double threshold) const {
+    unsigned int n = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i] > threshold) n++;
+    }
+    return n;
+}
 
+/*
+ * Same pass over the pixels as abs_frame_difference(), with the sum split
+ * over cols x rows tiles, so the memory traffic is the same as for the
+ * global sum
+ */
+TileDiff tiled_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, bool compute_averages, int cols, int rows){
+    return scan_frame(pFrame, pFramePrev, kernels::TILES | (compute_averages ? kernels::AVERAGES : 0), cols, rows).tiles;
+}
+
+Histogram color_histogram(AVFrame const *pFrame, bool compute_averages) {
+    return scan_frame(pFrame, NULL, kernels::HISTOGRAM | (compute_averages ? kernels::AVERAGES : 0)).hist;
+}
+
+/*
+ * Share of the pixels that moved to another bin: 1 - histogram
+ * intersection, from 0 (same colours) to 1 (no colour in common)
+ */
+double histogram_difference(Histogram const &a, Histogram const &b) {
+    if (a.nb_pix == 0 || a.nb_pix != b.nb_pix) {
+        throw FrameDimensionsDiffer();
+    }
+    uint64_t common = 0;
+    for (int i = 0; i < Histogram::BINS; i++) {
+        common += std::min(a.bins[i], b.bins[i]);
+    }
+    return 1 - static_cast<double>(common) / a.nb_pix;
+}
+
+/*
+ * Planar YUV formats read by planar_frame_difference(): sample size, bit
+ * depth and chroma subsampling
+ */
+struct PlanarLayout {
+    int bytes, bits;
+    int chroma_w, chroma_h;  // log2 of the subsampling
+};
+
+static bool planar_layout(int fmt, PlanarLayout &l) {
+    switch (fmt) {
+    case AV_PIX_FMT_YUV420P: case AV_PIX_FMT_YUVJ420P: l = {1, 8, 1, 1}; return true;
+    case AV_PIX_FMT_YUV422P: case AV_PIX_FMT_YUVJ422P: l = {1, 8, 1, 0}; return true;
+    case AV_PIX_FMT_YUV444P: case AV_PIX_FMT_YUVJ444P: l = {1, 8, 0, 0}; return true;
+    case AV_PIX_FMT_YUV420P10LE: l = {2, 10, 1, 1}; return true;
+    case AV_PIX_FMT_YUV422P10LE: l = {2, 10, 1, 0}; return true;
+    case AV_PIX_FMT_YUV444P10LE: l = {2, 10, 0, 0}; return true;
+    case AV_PIX_FMT_YUV420P12LE: l = {2, 12, 1, 1}; return true;
+    case AV_PIX_FMT_YUV422P12LE: l = {2, 12, 1, 0}; return true;
+    case AV_PIX_FMT_YUV444P12LE: l = {2, 12, 0, 0}; return true;
+    default: return false;
+    }
+}
+
+bool planar_supported(AVPixelFormat fmt) {
+    PlanarLayout l;
+    return planar_layout(fmt, l);
+}
+
+/* Luma and chroma sums of absolute differences, per pixel covered */
+struct PlanarSad {
+    uint64_t luma, chroma;
+};
+
+template <typename Sample, int Bits>
+static PlanarSad frame_sad(AVFrame const *a, AVFrame const *b, PlanarLayout const &l) {
+    const int cw = (a->width + (1 << l.chroma_w) - 1) >> l.chroma_w;
+    const int ch = (a->height + (1 << l.chroma_h) - 1) >> l.chroma_h;
+    PlanarSad sad;
+    sad.luma = kernels::planar_sad<Sample, Bits>(
+        a->data[0], a->linesize[0], b->data[0], b->linesize[0], a->width, a->height);
+    const uint64_t chroma =
+        kernels::planar_sad<Sample, Bits>(a->data[1], a->linesize[1], b->data[1], b->linesize[1], cw, ch) +
+        kernels::planar_sad<Sample, Bits>(a->data[2], a->linesize[2], b->data[2], b->linesize[2], cw, ch);
+    // Each chroma sample stands for the pixels it covers
+    sad.chroma = chroma << (l.chroma_w + l.chroma_h);
+    return sad;
+}
+
+/*
+ * Difference of two decoded YUV frames read from their planes, at their
+ * own bit depth: no conversion to 8-bit RGB first. The plane differences
+ * are weighted into the RGB one, so the same threshold applies: a luma
+ * step moves R, G and B alike and counts three times, a chroma step moves
+ * them by 2.1 times its size at most (BT.601). Limited range samples are
+ * stretched to full range first.
+ */
+FrameDiff planar_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev) {
+
+    check_dimensions(pFrame, pFramePrev);
+
+    PlanarLayout l;
+    if (!planar_layout(pFrame->format, l) || pFrame->format != pFramePrev->format) {
+        throw std::runtime_error("Unsupported pixel format for the planar difference.");
+    }
+
+    PlanarSad sad = {0, 0};
+    switch (l.bits) {
+    case 8: sad = frame_sad<uint8_t, 8>(pFrame, pFramePrev, l); break;
+    case 10: sad = frame_sad<uint16_t, 10>(pFrame, pFramePrev, l); break;
+    case 12: sad = frame_sad<uint16_t, 12>(pFrame, pFramePrev, l); break;
+    }
+
+    const bool full_range = pFrame->color_range == AVCOL_RANGE_JPEG ||
+                            pFrame->format == AV_PIX_FMT_YUVJ420P ||
+                            pFrame->format == AV_PIX_FMT_YUVJ422P ||
+                            pFrame->format == AV_PIX_FMT_YUVJ444P;
+    const double luma_weight = 3.0 * (full_range ? 1 : 255.0 / 219);
+    const double chroma_weight = 2.1 * (full_range ? 1 : 255.0 / 224);
+
+    const unsigned int nbpx = (pFrame->height * pFrame->width);
     FrameDiff result;
-    result.abs_diff = abs_diff;
-    result.abs_norm_diff = abs_norm_diff;
+    result.abs_diff = (luma_weight * sad.luma + chroma_weight * sad.chroma) /
+                      (1 << (l.bits - 8));
+    result.abs_norm_diff = result.abs_diff / nbpx;
     result.nb_pix = nbpx;
+    result.c1avg = result.c2avg = result.c3avg = 0;
+    return result;
+}
 
-    if (compute_averages){
-        const double c1avg = static_cast<double>(c1tot) / nbpx;
-        const double c2avg = static_cast<double>(c2tot) / nbpx;
-        const double c3avg = static_cast<double>(c3tot) / nbpx;
-        result.c1avg = c1avg;
-        result.c2avg = c2avg;
-        result.c3avg = c3avg;
-    }else{
-        result.c1avg = result.c2avg = result.c3avg = 0;
+/*
+ * Fit one translation plus zoom to the vectors of the predicted blocks
+ * (least squares, weighted by block area), then count the area within
+ * "tolerance" pixels of the fitted field. Vectors from a future frame point
+ * the other way and are flipped; a bi-predicted block has one vector per
+ * direction but covers its area once.
+ */
+MotionStats motion_vector_stats(AVFrame const *frame, double tolerance) {
+    MotionStats stats = {false, 1, 0};
+    AVFrameSideData const *sd =
+        av_frame_get_side_data(frame, AV_FRAME_DATA_MOTION_VECTORS);
+    if (sd == NULL || frame->width == 0 || frame->height == 0) {
+        return stats;
     }
+    AVMotionVector const *mvs = reinterpret_cast<AVMotionVector const *>(sd->data);
+    const size_t count = sd->size / sizeof(AVMotionVector);
 
-    return result;
+    /* Displacement from the reference, as if it were the past frame */
+    auto du = [&](size_t i) {
+        const double d = mvs[i].src_x - mvs[i].dst_x;
+        return mvs[i].source < 0 ? d : -d;
+    };
+    auto dv = [&](size_t i) {
+        const double d = mvs[i].src_y - mvs[i].dst_y;
+        return mvs[i].source < 0 ? d : -d;
+    };
+
+    std::vector<std::array<int, 4>> blocks;
+    blocks.reserve(count);
+    double weight = 0, mx = 0, my = 0, mu = 0, mv = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (mvs[i].source == 0) continue;
+        const double a = double(mvs[i].w) * mvs[i].h;
+        weight += a;
+        mx += a * mvs[i].dst_x;
+        my += a * mvs[i].dst_y;
+        mu += a * du(i);
+        mv += a * dv(i);
+        blocks.push_back({{mvs[i].dst_x, mvs[i].dst_y, mvs[i].w, mvs[i].h}});
+    }
+    stats.valid = true;
+    if (weight == 0) {
+        return stats;
+    }
+    mx /= weight;
+    my /= weight;
+    mu /= weight;
+    mv /= weight;
+
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    double area = 0;
+    for (auto const &b : blocks) {
+        area += double(b[2]) * b[3];
+    }
+
+    double num = 0, den = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (mvs[i].source == 0) continue;
+        const double a = double(mvs[i].w) * mvs[i].h;
+        const double x = mvs[i].dst_x - mx, y = mvs[i].dst_y - my;
+        num += a * (x * (du(i) - mu) + y * (dv(i) - mv));
+        den += a * (x * x + y * y);
+    }
+    const double zoom = den > 0 ? num / den : 0;
+
+    double coherent = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (mvs[i].source == 0) continue;
+        const double x = mvs[i].dst_x - mx, y = mvs[i].dst_y - my;
+        const double ru = du(i) - mu - zoom * x;
+        const double rv = dv(i) - mv - zoom * y;
+        if (ru * ru + rv * rv <= tolerance * tolerance) {
+            coherent += double(mvs[i].w) * mvs[i].h;
+        }
+    }
+
+    stats.intra = std::max(0.0, 1 - area / (double(frame->width) * frame->height));
+    stats.coherence = coherent / weight;
+    return stats;
 }
 
 }
@@ -1,11 +1,14 @@
 #ifndef PROCESSING_H
 #define PROCESSING_H
 
+#include <stdint.h>
 #include <stdexcept>
+#include <vector>
 
 extern "C" {
 #   include <libavcodec/avcodec.h>
 #   include <libavformat/avformat.h>
+#   include <libavutil/motion_vector.h>
 }
 
 namespace processing
@@ -32,8 +35,81 @@ struct FrameDiff {
     double c1avg, c2avg, c3avg;
 };
 
+/*
+ * Frame difference split over a grid of tiles: "tiles" holds the mean
+ * absolute difference per pixel of every tile, row by row, in the same
+ * unit as FrameDiff::abs_norm_diff.
+ */
+struct TileDiff {
+    FrameDiff global;
+    int cols, rows;
+    std::vector<double> tiles;
+
+    unsigned int changed(double threshold) const;
+};
+
+/*
+ * Colour histogram of an RGB24 frame quantized to 8 levels per channel:
+ * 512 bins, 2 KB to keep per frame instead of the frame itself
+ */
+struct Histogram {
+    static const int BINS = 512;
+    uint32_t bins[BINS];
+    unsigned int nb_pix;
+    double c1avg, c2avg, c3avg;
+};
+
+/*
+ * Statistics of the motion vectors a decoder exported for a frame
+ * (AV_CODEC_FLAG2_EXPORT_MVS). "intra" is the share of the picture with
+ * no vector from a past or a future frame, "coherence" the share of the
+ * predicted area whose vector follows one global pan and zoom. Intra
+ * pictures carry no vectors and are not valid.
+ */
+struct MotionStats {
+    bool valid;
+    double intra;
+    double coherence;
+
+    /* Cut likelihood from 0 (one camera move) to 100 (nothing predicted) */
+    inline double score() const {
+        return 100 * (intra + (1 - intra) * (1 - coherence) / 2);
+    }
+};
+
+/*
+ * Features of a frame from one fused pass over its pixels (see kernels.h);
+ * only those in "mask" are filled in
+ */
+struct FrameFeatures {
+    unsigned mask;
+    FrameDiff diff;
+    TileDiff tiles;
+    Histogram hist;
+};
+
+/*
+ * Estimate of FrameDiff::abs_norm_diff from a sample of the rows, and a
+ * bound on its error. The estimate is not exact and neither is the bound:
+ * a difference confined to rows the sample misses can exceed it. No bound
+ * from a sample can be exact: an unread pixel may differ by 255 in each
+ * channel.
+ */
+struct DiffEstimate {
+    double mean;
+    double bound;
+};
+
 YUVTriple get_yuv_colors(AVFrame const &frame);
 FrameDiff abs_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, bool compute_averages);
+TileDiff tiled_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, bool compute_averages, int cols = 8, int rows = 8);
+DiffEstimate sampled_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev, int stratum = 16);
+FrameFeatures scan_frame(AVFrame const *pFrame, AVFrame const *pFramePrev, unsigned features, int cols = 8, int rows = 8);
+Histogram color_histogram(AVFrame const *pFrame, bool compute_averages);
+double histogram_difference(Histogram const &a, Histogram const &b);
+bool planar_supported(AVPixelFormat fmt);
+FrameDiff planar_frame_difference(AVFrame const *pFrame, AVFrame const *pFramePrev);
+MotionStats motion_vector_stats(AVFrame const *frame, double tolerance = 4);
 
 }
 
@@ -0,0 +1,91 @@
+#include <series.h>
+
+namespace series {
+
+std::vector<bucket> regroup(std::vector<bucket> const &in, unsigned int factor) {
+    if (factor <= 1) return in;
+    std::vector<bucket> out((in.size() + factor - 1) / factor);
+    for (size_t i = 0; i < in.size(); i++) {
+        out[i / factor].merge(in[i]);
+    }
+    return out;
+}
+
+decimator::decimator(size_t capacity)
+    : capacity(capacity < 2 ? 2 : capacity), per_bucket(1), nb_frames(0) {
+    data.reserve(this->capacity);
+}
+
+void decimator::push(float v) {
+    if (data.empty() || data.back().count >= per_bucket) {
+        if (data.size() == capacity) {
+            fold();
+        }
+        if (data.empty() || data.back().count >= per_bucket) {
+            data.push_back(bucket());
+        }
+    }
+    data.back().add(v);
+    nb_frames++;
+}
+
+void decimator::fold() {
+    const size_t half = data.size() / 2;
+    for (size_t i = 0; i < half; i++) {
+        bucket merged = data[2 * i];
+        merged.merge(data[2 * i + 1]);
+        data[i] = merged;
+    }
+    if (data.size() % 2) {
+        data[half] = data.back();
+    }
+    data.resize((data.size() + 1) / 2);
+    per_bucket *= 2;
+}
+
+spill_file::spill_file(): fd(NULL), record_size(0), count(0) {}
+
+spill_file::~spill_file() {
+    close();
+}
+
+bool spill_file::open(std::string const &path, size_t record_size) {
+    close();
+    this->path = path;
+    this->record_size = record_size;
+    this->count = 0;
+    fd = fopen(path.c_str(), "w+b");
+    if (fd == NULL) {
+        return false;
+    }
+    // Batch many small records into few large sequential writes
+    buffer.resize(1 << 20);
+    setvbuf(fd, &buffer[0], _IOFBF, buffer.size());
+    return true;
+}
+
+void spill_file::append(void const *record) {
+    if (fd != NULL && fwrite(record, record_size, 1, fd) == 1) {
+        count++;
+    }
+}
+
+bool spill_file::rewind() {
+    return fd != NULL && fflush(fd) == 0 && fseek(fd, 0, SEEK_SET) == 0;
+}
+
+bool spill_file::read(void *record) {
+    return fd != NULL && fread(record, record_size, 1, fd) == 1;
+}
+
+void spill_file::close() {
+    if (fd != NULL) {
+        fclose(fd);
+        fd = NULL;
+        remove(path.c_str());
+    }
+    std::vector<char>().swap(buffer);
+    count = 0;
+}
+
+}
@@ -0,0 +1,115 @@
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace series
+{
+
+/*
+ * Summary of a run of consecutive samples (one graph column)
+ */
+struct bucket {
+    float min, max, sum;
+    unsigned int count;
+
+    bucket(): min(0), max(0), sum(0), count(0) {}
+
+    inline void add(float v) {
+        if (count == 0 || v < min) min = v;
+        if (count == 0 || v > max) max = v;
+        sum += v;
+        count++;
+    }
+
+    inline void merge(bucket const &other) {
+        if (other.count == 0) return;
+        if (count == 0 || other.min < min) min = other.min;
+        if (count == 0 || other.max > max) max = other.max;
+        sum += other.sum;
+        count += other.count;
+    }
+
+    inline float mean() const {
+        return count ? sum / count : 0;
+    }
+};
+
+/*
+ * Reduce "count" samples to at most "width" buckets in one linear pass.
+ * get(i) returns sample i.
+ */
+template <typename Get>
+std::vector<bucket> reduce(size_t count, size_t width, Get get) {
+    std::vector<bucket> out(count < width ? count : width);
+    if (out.empty()) return out;
+    const size_t n = out.size();
+    for (size_t i = 0; i < count; i++) {
+        out[i * n / count].add(get(i));
+    }
+    return out;
+}
+
+/*
+ * Merge every "factor" neighbouring buckets into one
+ */
+std::vector<bucket> regroup(std::vector<bucket> const &in, unsigned int factor);
+
+/*
+ * Fixed-capacity decimated copy of an unbounded series. When all buckets
+ * are used, neighbouring pairs are merged and every bucket covers twice
+ * as many samples, so memory stays constant whatever the length.
+ */
+class decimator {
+public:
+    explicit decimator(size_t capacity = 4096);
+
+    void push(float v);
+
+    inline size_t frames() const { return nb_frames; }
+    inline unsigned int frames_per_bucket() const { return per_bucket; }
+    inline std::vector<bucket> const &buckets() const { return data; }
+    inline size_t memory_usage() const { return data.capacity() * sizeof(bucket); }
+
+private:
+    void fold();
+
+    size_t capacity;
+    unsigned int per_bucket;
+    size_t nb_frames;
+    std::vector<bucket> data;
+};
+
+/*
+ * Append-only scratch file of fixed-size records, written with large
+ * buffered writes and read back sequentially once processing is done.
+ * The file is removed on close().
+ */
+class spill_file {
+public:
+    spill_file();
+    ~spill_file();
+
+    bool open(std::string const &path, size_t record_size);
+    void append(void const *record);
+    bool rewind();
+    bool read(void *record);
+    void close();
+
+    inline bool is_open() const { return fd != NULL; }
+    inline size_t size() const { return count; }
+
+private:
+    FILE *fd;
+    std::string path;
+    size_t record_size;
+    size_t count;
+    std::vector<char> buffer;
+};
+
+}
+
+#endif // SERIES_H
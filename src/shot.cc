@@ -16,9 +16,133 @@
 
 #include <shot.h>
 
+#include <image.h>
+
 shot::shot() {
   img_begin = NULL;
   img_end = NULL;
 }
 
 shot::~shot() {}
+
+/* Fixed-size fields are written as they are: the file never leaves this
+   process */
+template <typename T>
+static bool put(FILE *fd, const T &v) {
+  return fwrite(&v, sizeof(T), 1, fd) == 1;
+}
+
+template <typename T>
+static bool get(FILE *fd, T &v) {
+  return fread(&v, sizeof(T), 1, fd) == 1;
+}
+
+static bool put_string(FILE *fd, const string &str) {
+  uint32_t n = str.size();
+  return put(fd, n) && (n == 0 || fwrite(str.data(), 1, n, fd) == n);
+}
+
+static bool get_string(FILE *fd, string &str) {
+  uint32_t n;
+  if (!get(fd, n)) return false;
+  str.resize(n);
+  return n == 0 || fread(&str[0], 1, n, fd) == n;
+}
+
+static bool put_image(FILE *fd, const image *im) {
+  uint8_t present = im != NULL;
+  if (!put(fd, present)) return false;
+  if (im == NULL) return true;
+  uint8_t flags = (im->type == BEGIN ? 1 : 0) | (im->get_thumb_set() ? 2 : 0) |
+                  (im->get_shot_set() ? 4 : 0);
+  bool ok = put(fd, flags) && put(fd, im->id) && put(fd, im->width) &&
+            put(fd, im->height) && put_string(fd, im->img) &&
+            put(fd, uint32_t(im->thumbs.size()));
+  for (size_t i = 0; ok && i < im->thumbs.size(); i++) {
+    const image::rendition &r = im->thumbs[i];
+    ok = put_string(fd, r.src) && put(fd, r.width) && put(fd, r.height) &&
+         put(fd, r.sheet) && put(fd, r.x) && put(fd, r.y);
+  }
+  return ok;
+}
+
+static bool get_image(FILE *fd, film *f, image *&im) {
+  uint8_t present, flags;
+  int id, width, height;
+  uint32_t thumbs;
+  im = NULL;
+  if (!get(fd, present)) return false;
+  if (!present) return true;
+  if (!get(fd, flags) || !get(fd, id) || !get(fd, width) ||
+      !get(fd, height)) {
+    return false;
+  }
+  im = new image(f, width, height, id, (flags & 1) ? BEGIN : END, flags & 2,
+                 flags & 4);
+  bool ok = get_string(fd, im->img) && get(fd, thumbs);
+  for (uint32_t i = 0; ok && i < thumbs; i++) {
+    image::rendition r;
+    ok = get_string(fd, r.src) && get(fd, r.width) && get(fd, r.height) &&
+         get(fd, r.sheet) && get(fd, r.x) && get(fd, r.y);
+    im->thumbs.push_back(r);
+  }
+  if (!ok) {
+    delete im;
+    im = NULL;
+  }
+  return ok;
+}
+
+shot_store::shot_store() : fd(NULL), count(0) {}
+
+shot_store::~shot_store() { close(); }
+
+bool shot_store::open(const string &path) {
+  close();
+  this->path = path;
+  fd = fopen(path.c_str(), "w+b");
+  if (fd == NULL) {
+    return false;
+  }
+  buffer.resize(1 << 20);
+  setvbuf(fd, &buffer[0], _IOFBF, buffer.size());
+  return true;
+}
+
+bool shot_store::append(const shot &s) {
+  if (fd == NULL) return false;
+  bool ok = put(fd, s.myid) && put(fd, s.fduration) && put(fd, s.fbegin) &&
+            put(fd, s.msduration) && put(fd, s.msbegin) &&
+            put_image(fd, s.img_begin) && put_image(fd, s.img_end);
+  if (ok) count++;
+  return ok;
+}
+
+bool shot_store::rewind() {
+  return fd != NULL && fflush(fd) == 0 && fseek(fd, 0, SEEK_SET) == 0;
+}
+
+bool shot_store::read(shot &s, film *f) {
+  s.img_begin = s.img_end = NULL;
+  if (fd == NULL || !get(fd, s.myid) || !get(fd, s.fduration) ||
+      !get(fd, s.fbegin) || !get(fd, s.msduration) || !get(fd, s.msbegin) ||
+      !get_image(fd, f, s.img_begin)) {
+    return false;
+  }
+  if (!get_image(fd, f, s.img_end)) {
+    delete s.img_begin;
+    s.img_begin = NULL;
+    return false;
+  }
+  return true;
+}
+
+void shot_store::close() {
+  if (fd != NULL) {
+    fclose(fd);
+    fd = NULL;
+    remove(path.c_str());
+  }
+  vector<char>().swap(buffer);
+  count = 0;
+}
@@ -5,8 +5,11 @@
 
 #ifndef __SHOT_H__
 #define __SHOT_H__
-#include <image.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
 
+class film;
 class image;
 
 class shot {
@@ -29,4 +32,31 @@ class shot {
   ~shot();
 };
 
+/*
+ * Scratch file of finished shots and their images, for bounded memory
+ * mode: appended with large buffered writes and read back in order when
+ * the results are written. The file is removed on close().
+ */
+class shot_store {
+  FILE *fd;
+  std::string path;
+  size_t count;
+  std::vector<char> buffer;
+
+ public:
+  shot_store();
+  ~shot_store();
+
+  bool open(const std::string &path);
+  /* Write "s" with its images, which the caller may then delete */
+  bool append(const shot &s);
+  bool rewind();
+  /* The next shot, with images of its own created for film "f" */
+  bool read(shot &s, film *f);
+  void close();
+
+  inline bool is_open() const { return fd != NULL; }
+  inline size_t size() const { return count; }
+};
+
 #endif /* !__SHOT_H__ */
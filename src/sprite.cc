@@ -0,0 +1,108 @@
+#include <sprite.h>
+
+#include <stdio.h>
+#include <format.h>
+
+namespace sprite {
+
+sheet::sheet(std::string const &dir, std::string const &name, int columns,
+             int rows, int cell_width, int cell_height, pack::writer *archive)
+    : dir(dir), name(name), columns(columns < 1 ? 1 : columns),
+      rows(rows < 1 ? 1 : rows), cell_w(cell_width), cell_h(cell_height),
+      archive(archive), canvas(NULL), used(0), count(0), sws(NULL) {}
+
+sheet::~sheet() {
+    flush();
+    sws_freeContext(sws);
+}
+
+std::string sheet::file_name(int index) const {
+    return fmt::format("{}_{:04}.jpg", name, index);
+}
+
+/*
+ * Reserve the next free cell, starting a new sheet if needed
+ */
+placement sheet::next_cell(int width, int height) {
+    if (canvas == NULL) {
+        canvas = gdImageCreateTrueColor(columns * cell_w, rows * cell_h);
+    }
+    placement p;
+    p.sheet = count;
+    p.x = (used % columns) * cell_w;
+    p.y = (used / columns) * cell_h;
+    p.width = width < cell_w ? width : cell_w;
+    p.height = height < cell_h ? height : cell_h;
+    used++;
+    return p;
+}
+
+placement sheet::add(gdImagePtr thumb) {
+    placement p = next_cell(thumb->sx, thumb->sy);
+    gdImageCopy(canvas, thumb, p.x, p.y, 0, 0, p.width, p.height);
+    return p;
+}
+
+placement sheet::add(AVFrame *thumb) {
+    placement p = next_cell(thumb->width, thumb->height);
+
+    sws = sws_getCachedContext(sws, thumb->width, thumb->height,
+                               AVPixelFormat(thumb->format), p.width, p.height,
+                               AV_PIX_FMT_RGB24, SWS_POINT, NULL, NULL, NULL);
+    if (sws != NULL) {
+        const int linesize = p.width * 3;
+        rgb.resize(size_t(linesize) * p.height);
+        uint8_t *dst[4] = {&rgb[0], NULL, NULL, NULL};
+        int dst_linesize[4] = {linesize, 0, 0, 0};
+        sws_scale(sws, thumb->data, thumb->linesize, 0, thumb->height, dst,
+                  dst_linesize);
+        for (int y = 0; y < p.height; y++) {
+            const uint8_t *row = &rgb[size_t(y) * linesize];
+            int *out = canvas->tpixels[p.y + y] + p.x;
+            for (int x = 0; x < p.width; x++) {
+                out[x] = gdTrueColor(row[3 * x], row[3 * x + 1], row[3 * x + 2]);
+            }
+        }
+    }
+    return p;
+}
+
+/*
+ * Write the current sheet, if it has any thumbnail
+ */
+bool sheet::flush() {
+    if (canvas == NULL) return true;
+
+    bool ok = false;
+    std::string path = dir + "/" + file_name(count);
+    if (archive != NULL) {
+        int size = 0;
+        void *data = gdImageJpegPtr(canvas, &size, 90);
+        if (data != NULL) {
+            pack::entry e;
+            e.offset = 0;
+            e.length = 0;
+            e.frame = -1;
+            e.shot = -1;
+            e.type = pack::TYPE_IN;
+            e.kind = pack::KIND_SHEET;
+            e.height = uint16_t(rows * cell_h);
+            e.name = path;
+            ok = archive->append(data, size, e);
+            gdFree(data);
+        }
+    } else {
+        FILE *fd = fopen(path.c_str(), "wb");
+        if (fd != NULL) {
+            gdImageJpeg(canvas, fd, 90);
+            ok = fclose(fd) == 0;
+        }
+    }
+    gdImageDestroy(canvas);
+    canvas = NULL;
+    used = 0;
+    count++;
+    return ok;
+}
+
+}
@@ -0,0 +1,75 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <gd.h>
+
+#include <pack.h>
+
+extern "C" {
+#   include <libavutil/frame.h>
+#   include <libswscale/swscale.h>
+}
+
+namespace sprite
+{
+
+/*
+ * Position of one thumbnail in a sheet
+ */
+struct placement {
+    int sheet;
+    int x, y, width, height;
+};
+
+/*
+ * Packs equally sized thumbnails into sheets of columns x rows cells,
+ * filled row by row. The caller writes a sheet with flush() once it is
+ * full(), and the last one at the end: one JPEG file named
+ * <name>_<index>.jpg in "dir", or with an "archive", an entry of that
+ * name under "dir" in the pack.
+ */
+class sheet {
+public:
+    sheet(std::string const &dir, std::string const &name, int columns,
+          int rows, int cell_width, int cell_height,
+          pack::writer *archive = NULL);
+    ~sheet();
+
+    placement add(gdImagePtr thumb);
+    placement add(AVFrame *thumb);
+    /* Write the current sheet: false if it could not be stored */
+    bool flush();
+
+    std::string file_name(int index) const;
+
+    inline bool full() const { return used == columns * rows; }
+    /* Index of the sheet being filled */
+    inline int index() const { return count; }
+
+    inline int cell_width() const { return cell_w; }
+    inline int cell_height() const { return cell_h; }
+
+private:
+    placement next_cell(int width, int height);
+
+    std::string dir;
+    std::string name;
+    int columns, rows;
+    int cell_w, cell_h;
+    pack::writer *archive;
+    gdImagePtr canvas;
+    int used;   // cells used in the current sheet
+    int count;  // sheets written
+
+    // RGB conversion of decoded thumbnails
+    SwsContext *sws;
+    std::vector<uint8_t> rgb;
+};
+
+}
+
+#endif // SPRITE_H
@@ -0,0 +1,91 @@
+#include <svg.h>
+
+namespace svg {
+
+// Write the buffer out once it holds this many bytes
+static const size_t FLUSH_SIZE = 1 << 16;
+
+writer::writer(): fd(NULL) {}
+
+writer::~writer() {
+    close();
+}
+
+bool writer::open(std::string const &path, int width, int height) {
+    close();
+    fd = fopen(path.c_str(), "w");
+    if (fd == NULL) {
+        return false;
+    }
+    out.clear();
+    out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+              "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"{0}\" "
+              "height=\"{1}\" viewBox=\"0 0 {0} {1}\" "
+              "shape-rendering=\"crispEdges\">\n",
+              width, height);
+    return true;
+}
+
+void writer::close() {
+    if (fd == NULL) return;
+    out << "</svg>\n";
+    flush(true);
+    fclose(fd);
+    fd = NULL;
+}
+
+void writer::flush(bool force) {
+    if (fd != NULL && (force || out.size() >= FLUSH_SIZE)) {
+        fwrite(out.data(), 1, out.size(), fd);
+        out.clear();
+    }
+}
+
+void writer::rect(int x, int y, int width, int height, char const *fill) {
+    out.write("<rect x=\"{}\" y=\"{}\" width=\"{}\" height=\"{}\" fill=\"{}\"/>\n",
+              x, y, width, height, fill);
+    flush(false);
+}
+
+void writer::line(int x1, int y1, int x2, int y2, char const *stroke) {
+    out.write("<line x1=\"{}\" y1=\"{}\" x2=\"{}\" y2=\"{}\" stroke=\"{}\"/>\n",
+              x1, y1, x2, y2, stroke);
+    flush(false);
+}
+
+void writer::line(int x1, int y1, int x2, int y2, int r, int g, int b) {
+    out.write("<line x1=\"{}\" y1=\"{}\" x2=\"{}\" y2=\"{}\" "
+              "stroke=\"#{:02x}{:02x}{:02x}\"/>\n",
+              x1, y1, x2, y2, r, g, b);
+    flush(false);
+}
+
+void writer::text(int x, int y, std::string const &s, char const *fill) {
+    out.write("<text x=\"{}\" y=\"{}\" fill=\"{}\" font-family=\"sans-serif\" "
+              "font-size=\"14\" text-anchor=\"middle\">{}</text>\n",
+              x, y, fill, s);
+    flush(false);
+}
+
+void writer::begin_polylines(size_t count) {
+    while (points.size() < count) {
+        points.push_back(std::unique_ptr<fmt::MemoryWriter>(new fmt::MemoryWriter()));
+    }
+    for (size_t i = 0; i < count; i++) {
+        points[i]->clear();
+    }
+}
+
+void writer::end_polyline(size_t polyline, char const *stroke, bool dashed) {
+    fmt::MemoryWriter &p = *points[polyline];
+    if (p.size() == 0) return;
+    out.write("<polyline fill=\"none\" stroke=\"{}\"{} points=\"", stroke,
+              dashed ? " stroke-dasharray=\"1,1\"" : "");
+    flush(true);
+    fwrite(p.data(), 1, p.size(), fd);
+    out << "\"/>\n";
+    p.clear();
+    flush(false);
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef SVG_H
+#define SVG_H
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <format.h>
+
+namespace svg
+{
+
+/*
+ * Streaming SVG document writer. Elements are formatted into one reused
+ * memory buffer that is written out whenever it gets large, so the whole
+ * document never has to be held in memory. Polylines are collected point
+ * by point in their own reused buffers, which lets several of them be
+ * built in the same pass over the data.
+ */
+class writer {
+public:
+    writer();
+    ~writer();
+
+    bool open(std::string const &path, int width, int height);
+    void close();
+
+    void rect(int x, int y, int width, int height, char const *fill);
+    void line(int x1, int y1, int x2, int y2, char const *stroke);
+    void line(int x1, int y1, int x2, int y2, int r, int g, int b);
+    void text(int x, int y, std::string const &s, char const *fill);
+
+    void begin_polylines(size_t count);
+    inline void point(size_t polyline, int x, int y) {
+        *points[polyline] << ' ' << x << ',' << y;
+    }
+    void end_polyline(size_t polyline, char const *stroke, bool dashed = false);
+
+    inline bool is_open() const { return fd != NULL; }
+
+private:
+    void flush(bool force);
+
+    FILE *fd;
+    fmt::MemoryWriter out;
+    std::vector<std::unique_ptr<fmt::MemoryWriter> > points;
+};
+
+}
+
+#endif // SVG_H
@@ -0,0 +1,119 @@
+/*
+ * shotdetect-pack: list or extract the images of a pack written with
+ * --pack (see pack.h for the format).
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <string>
+
+#include <pack.h>
+
+using namespace std;
+
+static void show_help(char **argv) {
+  printf(
+      "\nUsage: %s command file.pack [name...]\n"
+      "ls      : list the images: name, frame, shot, type, kind (shot, thumb\n"
+      "          or sheet), height, size\n"
+      "extract : write the named images (all of them without a name) under\n"
+      "          the current directory, at the relative path they are named by\n",
+      argv[0]);
+}
+
+/*
+ * Create the directories leading to "path"
+ */
+static bool make_parents(const string &path) {
+  for (size_t slash = path.find('/'); slash != string::npos;
+       slash = path.find('/', slash + 1)) {
+    const string dir = path.substr(0, slash);
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) return false;
+  }
+  return true;
+}
+
+static bool write_entry(const pack::reader &in, const pack::entry &e) {
+  // A shot image and its thumbnail only differ by their directory, so the
+  // whole relative path is kept; nothing is written outside of "."
+  const string &path = e.name;
+  if (path.empty() || path[0] == '/' || path == ".." ||
+      path.compare(0, 3, "../") == 0 || path.find("/../") != string::npos ||
+      (path.size() >= 3 && path.compare(path.size() - 3, 3, "/..") == 0)) {
+    fprintf(stderr, "%s: not a relative path, skipped\n", path.c_str());
+    return false;
+  }
+  if (!make_parents(path)) {
+    fprintf(stderr, "%s: cannot create its directory\n", path.c_str());
+    return false;
+  }
+
+  FILE *out = fopen(path.c_str(), "wb");
+  if (out == NULL) {
+    fprintf(stderr, "%s: cannot create\n", path.c_str());
+    return false;
+  }
+  bool ok = fwrite(in.data(e), 1, e.length, out) == e.length;
+  ok = fclose(out) == 0 && ok;
+  if (!ok) fprintf(stderr, "%s: write error\n", path.c_str());
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    show_help(argv);
+    return 1;
+  }
+  const string command = argv[1];
+  if (command != "ls" && command != "extract") {
+    show_help(argv);
+    return 1;
+  }
+
+  pack::reader in;
+  if (!in.open(argv[2])) {
+    fprintf(stderr, "%s: not a pack file\n", argv[2]);
+    return 1;
+  }
+
+  if (command == "ls") {
+    const vector<pack::entry> &entries = in.entries();
+    for (size_t i = 0; i < entries.size(); i++) {
+      const pack::entry &e = entries[i];
+      printf("%s\t%d\t%d\t%s\t%s\t%u\t%u\n", e.name.c_str(), e.frame, e.shot,
+             e.type == pack::TYPE_IN ? "in" : "out",
+             e.kind == pack::KIND_SHOT    ? "shot"
+             : e.kind == pack::KIND_THUMB ? "thumb"
+                                          : "sheet",
+             unsigned(e.height),
+             unsigned(e.length));
+    }
+    return 0;
+  }
+
+  int status = 0;
+  if (argc == 3) {
+    const vector<pack::entry> &entries = in.entries();
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (!write_entry(in, entries[i])) status = 1;
+    }
+  }
+  for (int i = 3; i < argc; i++) {
+    const pack::entry *e = in.find(argv[i]);
+    if (e == NULL) {
+      fprintf(stderr, "%s: not in %s\n", argv[i], argv[2]);
+      status = 1;
+    } else if (!write_entry(in, *e)) {
+      status = 1;
+    }
+  }
+  return status;
+}
@@ -69,6 +69,41 @@ xmlChar *xml::ConvertInput(const char *in, const char *encoding) {
   return out;
 }
 
+/*
+ * Write one <img> element of a shot
+ */
+static void write_img(xmlTextWriterPtr writer, const char *size,
+                      const char *type, const string &src, int width,
+                      int height, int x = -1, int y = -1) {
+  ostringstream strflx;
+  xmlTextWriterStartElement(writer, BAD_CAST "img");
+  xmlTextWriterWriteAttribute(writer, BAD_CAST "size", BAD_CAST size);
+  xmlTextWriterWriteAttribute(writer, BAD_CAST "type", BAD_CAST type);
+  xmlTextWriterWriteAttribute(writer, BAD_CAST "src", BAD_CAST src.c_str());
+
+  strflx << width;
+  xmlTextWriterWriteAttribute(writer, BAD_CAST "width",
+                              BAD_CAST strflx.str().c_str());
+
+  strflx.str("");
+  strflx << height;
+  xmlTextWriterWriteAttribute(writer, BAD_CAST "height",
+                              BAD_CAST strflx.str().c_str());
+
+  /* Thumbnail packed in a sprite sheet */
+  if (x >= 0 && y >= 0) {
+    strflx.str("");
+    strflx << x;
+    xmlTextWriterWriteAttribute(writer, BAD_CAST "x",
+                                BAD_CAST strflx.str().c_str());
+    strflx.str("");
+    strflx << y;
+    xmlTextWriterWriteAttribute(writer, BAD_CAST "y",
+                                BAD_CAST strflx.str().c_str());
+  }
+  xmlTextWriterEndElement(writer);
+}
+
 void xml::write_data(string &filename) {
   int rc;
   xmlTextWriterPtr writer;
@@ -79,7 +114,6 @@ void xml::write_data(string &filename) {
   /*
    * Create a new XmlWriter for DOM, with no compression.
    */
-  list<shot>::iterator il;
   writer = xmlNewTextWriterDoc(&doc, 0);
 
   rc = xmlTextWriterStartDocument(writer, NULL, MY_ENCODING, NULL);
@@ -151,135 +185,86 @@ void xml::write_data(string &filename) {
   xmlTextWriterStartElement(writer, BAD_CAST "shots");
 
   /* Mise en place des elements shots */
-  for (il = f->shots.begin(); il != f->shots.end(); il++) {
+  f->for_each_shot([&](shot &s) {
     strflx.str("");
-    strflx << (*il).myid;
+    strflx << s.myid;
     rc = xmlTextWriterStartElement(writer, BAD_CAST "shot");
     rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "id",
                                      BAD_CAST strflx.str().c_str());
 
     strflx.str("");
-    strflx << (*il).fduration;
+    strflx << s.fduration;
 
     rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "fduration",
                                      BAD_CAST strflx.str().c_str());
 
     strflx.str("");
-    strflx << int((*il).msduration);
+    strflx << int(s.msduration);
     rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "msduration",
                                      BAD_CAST strflx.str().c_str());
 
     strflx.str("");
-    strflx << (*il).fbegin;
+    strflx << s.fbegin;
     rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "fbegin",
                                      BAD_CAST strflx.str().c_str());
 
     strflx.str("");
-    strflx << int((*il).msbegin);
+    strflx << int(s.msbegin);
     rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "msbegin",
                                      BAD_CAST strflx.str().c_str());
 
     /*
-     * Element image
+     * Element image: the original size and every thumbnail rendition
      */
-
-    if ((*il).img_begin != NULL) {
+    image *images[] = {s.img_begin, s.img_end};
+    const char *types[] = {"in", "out"};
+    for (int i = 0; i < 2; i++) {
+      if (images[i] == NULL) continue;
       if (f->shot_set) {
-        rc = xmlTextWriterStartElement(writer, BAD_CAST "img");
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "size",
-                                         BAD_CAST "original");
-        rc =
-            xmlTextWriterWriteAttribute(writer, BAD_CAST "type", BAD_CAST "in");
-
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "src",
-                                         BAD_CAST(*il).img_begin->img.c_str());
-
-        strflx.str("");
-        strflx << (*il).img_begin->width;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "width",
-                                         BAD_CAST strflx.str().c_str());
-
-        strflx.str("");
-        strflx << (*il).img_begin->height;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "height",
-                                         BAD_CAST strflx.str().c_str());
-        rc = xmlTextWriterEndElement(writer);
+        write_img(writer, "original", types[i], images[i]->img,
+                  images[i]->width, images[i]->height);
       }
-      /*
-       * Element thumb
-       */
       if (f->thumb_set) {
-        rc = xmlTextWriterStartElement(writer, BAD_CAST "img");
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "size",
-                                         BAD_CAST "thumb");
-        rc =
-            xmlTextWriterWriteAttribute(writer, BAD_CAST "type", BAD_CAST "in");
-
-        rc = xmlTextWriterWriteAttribute(
-            writer, BAD_CAST "src", BAD_CAST(*il).img_begin->thumb.c_str());
-
-        strflx.str("");
-        strflx << (*il).img_begin->width_thumb;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "width",
-                                         BAD_CAST strflx.str().c_str());
-
-        strflx.str("");
-        strflx << (*il).img_begin->height_thumb;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "height",
-                                         BAD_CAST strflx.str().c_str());
-        rc = xmlTextWriterEndElement(writer);
+        for (size_t t = 0; t < images[i]->thumbs.size(); t++) {
+          const image::rendition &r = images[i]->thumbs[t];
+          write_img(writer, "thumb", types[i], r.src, r.width, r.height,
+                    r.sheet >= 0 ? r.x : -1, r.sheet >= 0 ? r.y : -1);
+        }
       }
     }
+    xmlTextWriterEndElement(writer);
+  });
+  xmlTextWriterEndElement(writer);
 
-    if ((*il).img_end != NULL) {
-      /*
-       * Element image
-       */
-      if (f->shot_set) {
-        rc = xmlTextWriterStartElement(writer, BAD_CAST "img");
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "size",
-                                         BAD_CAST "original");
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "type",
-                                         BAD_CAST "out");
-
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "src",
-                                         BAD_CAST(*il).img_end->img.c_str());
-
-        strflx.str("");
-        strflx << (*il).img_end->width;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "width",
-                                         BAD_CAST strflx.str().c_str());
-
-        strflx.str("");
-        strflx << (*il).img_end->height;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "height",
-                                         BAD_CAST strflx.str().c_str());
-        rc = xmlTextWriterEndElement(writer);
-      }
-      /*
-       * Element thumb
-       */
-      if (f->thumb_set) {
-        rc = xmlTextWriterStartElement(writer, BAD_CAST "img");
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "size",
-                                         BAD_CAST "thumb");
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "type",
-                                         BAD_CAST "out");
-
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "src",
-                                         BAD_CAST(*il).img_end->thumb.c_str());
-
-        strflx.str("");
-        strflx << (*il).img_end->width_thumb;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "width",
-                                         BAD_CAST strflx.str().c_str());
-
-        strflx.str("");
-        strflx << (*il).img_end->height_thumb;
-        rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "height",
-                                         BAD_CAST strflx.str().c_str());
-        rc = xmlTextWriterEndElement(writer);
-      }
+  /*
+   * Gradual transitions (fades, dissolves) found between the shots
+   */
+  if (!f->transitions.empty()) {
+    xmlTextWriterStartElement(writer, BAD_CAST "transitions");
+    for (size_t i = 0; i < f->transitions.size(); i++) {
+      const decision::transition &t = f->transitions[i];
+      xmlTextWriterStartElement(writer, BAD_CAST "transition");
+      strflx.str("");
+      strflx << i;
+      xmlTextWriterWriteAttribute(writer, BAD_CAST "id",
+                                  BAD_CAST strflx.str().c_str());
+      strflx.str("");
+      strflx << t.begin;
+      xmlTextWriterWriteAttribute(writer, BAD_CAST "fbegin",
+                                  BAD_CAST strflx.str().c_str());
+      strflx.str("");
+      strflx << t.end;
+      xmlTextWriterWriteAttribute(writer, BAD_CAST "fend",
+                                  BAD_CAST strflx.str().c_str());
+      strflx.str("");
+      strflx << int((t.begin * 1000) / f->fps);
+      xmlTextWriterWriteAttribute(writer, BAD_CAST "msbegin",
+                                  BAD_CAST strflx.str().c_str());
+      strflx.str("");
+      strflx << int((t.end * 1000) / f->fps);
+      xmlTextWriterWriteAttribute(writer, BAD_CAST "msend",
+                                  BAD_CAST strflx.str().c_str());
+      xmlTextWriterEndElement(writer);
     }
     xmlTextWriterEndElement(writer);
   }